@@ -0,0 +1,658 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "citation_table.h"
+#include "loader.h"
+#include "output.h"
+#include "scanner.h"
+#include "tools/mock_api.hpp"
+#include "utils.hpp"
+#include "web.h"
+
+/*
+Benchmarks for docman's hot paths.
+
+Usage: docman_bench [--json FILE] [--full] [document size in MiB, default 4] [database entries, default 100000]
+
+The scanning and output cases run on a 1 MiB document and on one of the given size, the
+loading cases on a 10K-entry citations file and on one with the given number of entries.
+`--full` measures the large sizes at 1 GiB and 1M entries, including the slow line-by-line
+scan baselines, which are otherwise skipped above 64 MiB. Books and webpages are rendered
+against the stand-in API of `tools/mock_api.hpp`, served in-process on a local port.
+
+Each case is run repeatedly for about half a second and reported as time per run and
+throughput over the synthetic input. `--json FILE` also writes the results to `FILE`, one
+object per case, for tracking them across builds.
+*/
+
+// every heap allocation in the process is counted, see `countAllocations`
+static std::atomic<size_t> allocationCount{0};
+
+// the results of all cases run so far, written out by `--json`
+static nlohmann::json results = nlohmann::json::array();
+
+// not inlined, so the compiler does not pair the malloc inside with a delete in a caller
+// and warn about mismatched allocation functions (-Wmismatched-new-delete)
+[[gnu::noinline]] void* operator new(size_t size) {
+    ++allocationCount;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static void countAllocations(const std::string& name, size_t items, const std::function<void()>& fn) {
+    // report the heap allocations made by one run of `fn` per processed item
+    size_t before = allocationCount;
+    fn();
+    double perItem = static_cast<double>(allocationCount - before) / items;
+    results.push_back({{"name", name}, {"items", items}, {"allocations_per_item", perItem}});
+    std::cout << std::left << std::setw(32) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(2) << perItem << " allocs/item"
+              << std::endl;
+}
+
+static void bench(const std::string& name, size_t amount, const std::string& unit, const std::function<void()>& fn) {
+    /*
+    Run `fn` repeatedly for about half a second and report the time per run and the
+    throughput, where one run processes `amount` bytes (unit "B") or `amount` items.
+    */
+    using Clock = std::chrono::steady_clock;
+    fn();  // warm up
+
+    size_t runs = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    do {
+        fn();
+        ++runs;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(500));
+
+    double seconds = std::chrono::duration<double>(elapsed).count() / runs;
+    // items are counted in millions, or in thousands for slow cases like web lookups
+    std::string scale = amount / seconds >= 1e6 ? "M" : "k";
+    double rate = unit == "B" ? amount / seconds / (1 << 20) : amount / seconds / (scale == "M" ? 1e6 : 1e3);
+    results.push_back({
+        {"name", name},
+        {"runs", runs},
+        {"time_per_run_ms", seconds * 1e3},
+        {unit == "B" ? "bytes_per_second" : unit + "_per_second", amount / seconds}
+    });
+    std::cout << std::left << std::setw(32) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(3) << seconds * 1e3 << " ms"
+              << std::setw(12) << std::setprecision(1) << rate << (unit == "B" ? " MiB/s" : " " + scale + unit + "/s")
+              << std::endl;
+}
+
+static void bench(const std::string& name, size_t bytes, const std::function<void()>& fn) {
+    bench(name, bytes, "B", fn);
+}
+
+static std::string makeDocument(size_t bytes) {
+    /*
+    Build a document of roughly `bytes` bytes: prose lines, about one in four of them
+    citing one or two of 1000 distinct IDs.
+    */
+    std::string doc;
+    doc.reserve(bytes + 128);
+    for (size_t line = 0; doc.size() < bytes; line++) {
+        doc += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor";
+        if (line % 4 == 0) {
+            doc += " as shown in [ref" + std::to_string(line % 1000) + "]";
+        }
+        if (line % 12 == 0) {
+            doc += " and [ref" + std::to_string((line * 7) % 1000) + "]";
+        }
+        doc += ".\n";
+    }
+    return doc;
+}
+
+static std::set<std::string> scanWithRegex(const std::string& doc) {
+    // the original line-by-line std::regex scan, kept as the baseline
+    std::set<std::string> citationIDs;
+    std::regex citationRegex{"\\[(.*?)\\]"};
+    std::istringstream input{doc};
+    std::string line;
+    int bracketCount = 0;
+    while (std::getline(input, line)) {
+        for (char c : line) {
+            if (c == '[') {
+                ++bracketCount;
+            } else if (c == ']') {
+                --bracketCount;
+            }
+        }
+        std::smatch matches;
+        std::string::const_iterator searchStart(line.cbegin());
+        while (std::regex_search(searchStart, line.cend(), matches, citationRegex)) {
+            citationIDs.insert(matches[1].str());
+            searchStart = matches.suffix().first;
+        }
+    }
+    return citationIDs;
+}
+
+static std::set<std::string> scanWithScanner(const std::string& doc) {
+    CitationScanner scanner;
+    std::istringstream input{doc};
+    std::string line;
+    while (std::getline(input, line)) {
+        scanner.scan(line);
+    }
+    return scanner.citationIDs();
+}
+
+static std::set<std::string> scanBlock(const std::string& doc, ScanKernel kernel) {
+    CitationScanner scanner{kernel};
+    scanner.scan(doc);
+    return scanner.citationIDs();
+}
+
+static std::set<std::string> scanParallel(const std::string& doc, size_t threads) {
+    CitationScanner scanner;
+    scanner.scan(doc, threads);
+    return scanner.citationIDs();
+}
+
+static bool sameScan(const std::string& doc, size_t threads) {
+    // the parallel scan must agree with the sequential one on everything it reports
+    CitationScanner sequential, parallel;
+    sequential.scan(doc);
+    parallel.scan(doc, threads);
+    return sequential.failed() == parallel.failed() &&
+           sequential.balanced() == parallel.balanced() &&
+           sequential.citationIDs() == parallel.citationIDs();
+}
+
+static bool sameBulkLoad(size_t threads, bool prefilled) {
+    /*
+    A table built in bulk on `threads` threads must map every ID to the same citation as
+    one built by adding the citations one after another. Many IDs occur several times, so
+    the citation added last has to win; with `prefilled`, both tables already hold
+    citations before the bulk load starts.
+    */
+    const size_t entries = 100000;
+    const size_t distinct = 70000;
+    std::mt19937 rng{7};
+    CitationTable sequential, bulk;
+    auto add = [](CitationTable& table, size_t i, size_t key) {
+        table.add(Article(
+            "ref" + std::to_string(key), "Title " + std::to_string(i), "Author", "Journal", 2020, 1, 2, true,
+            table.resource()
+        ));
+    };
+    if (prefilled) {
+        for (size_t i = 0; i < 1000; i++) {
+            add(sequential, i, i * 3);
+            add(bulk, i, i * 3);
+        }
+    }
+    bulk.beginBulk();
+    for (size_t i = 0; i < entries; i++) {
+        size_t key = rng() % distinct;
+        add(sequential, entries + i, key);
+        add(bulk, entries + i, key);
+    }
+    bulk.endBulk(threads);
+
+    if (sequential.size() != bulk.size()) {
+        return false;
+    }
+    bool same = true;
+    sequential.forEach([&](const Citation& citation) {
+        auto other = bulk.find(citation.getId());
+        same = same && other != nullptr && other->toString() == citation.toString();
+    });
+    return same;
+}
+
+static std::string encodeWithStringstream(const std::string& s) {
+    // the original per-character encoder, kept as the baseline
+    std::string encoded;
+    char c;
+    for (size_t i = 0; i < s.length(); i++) {
+        c = s[i];
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += c;
+        } else if (c == ' ') {
+            encoded += '+';
+        } else {
+            encoded += '%';
+            std::stringstream ss;
+            ss << std::hex << (int) c;
+            encoded += ss.str();
+        }
+    }
+    return encoded;
+}
+
+static std::vector<std::string> makeUrls(size_t count) {
+    // long URLs with paths, query strings and some non-ASCII text, as found in webpage citations
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; i++) {
+        urls.push_back(
+            "https://www.example-journal.org/articles/2024/volume-" + std::to_string(i % 97) +
+            "/issue_" + std::to_string(i % 13) + "/an-unusually-long-article-slug-about-citation-management-number-" +
+            std::to_string(i) + "?utm_source=newsletter&utm_medium=email&ref=docman bench&lang=" +
+            (i % 3 == 0 ? "\xe4\xb8\xad\xe6\x96\x87" : "en")
+        );
+    }
+    return urls;
+}
+
+#ifdef _WIN32
+static const char* NULL_DEVICE = "NUL";
+#else
+static const char* NULL_DEVICE = "/dev/null";
+#endif
+
+static void writeWithEndl(const std::string& doc) {
+    // the original output path: one std::endl (and so one flush) per line
+    std::ofstream output{NULL_DEVICE};
+    std::istringstream input{doc};
+    std::string line;
+    while (std::getline(input, line)) {
+        output << line << std::endl;
+    }
+}
+
+static void writeBuffered(const std::string& doc) {
+    std::ofstream output{NULL_DEVICE};
+    OutputBuffer buffer{output};
+    std::istringstream input{doc};
+    std::string line;
+    while (std::getline(input, line)) {
+        buffer.write(line).put('\n');
+    }
+    buffer.flush();
+}
+
+static std::string makeDatabase(size_t entries) {
+    // a citations file with equal shares of books, webpages and articles
+    std::string db = "{\"citations\":[\n";
+    for (size_t i = 0; i < entries; i++) {
+        std::string id = "\"id\":\"ref" + std::to_string(i) + "\"";
+        if (i % 3 == 0) {
+            db += "{\"type\":\"book\"," + id + ",\"isbn\":\"978-7-" + std::to_string(i) + "\"}";
+        } else if (i % 3 == 1) {
+            db += "{\"type\":\"webpage\"," + id + ",\"url\":\"https://example.com/page/" + std::to_string(i) + "\"}";
+        } else {
+            db += "{\"type\":\"article\"," + id + ",\"title\":\"Title " + std::to_string(i) +
+                  "\",\"author\":\"Author\",\"journal\":\"Journal\",\"year\":2020,\"volume\":1,\"issue\":2}";
+        }
+        db += i + 1 < entries ? ",\n" : "\n";
+    }
+    return db + "]}\n";
+}
+
+static std::unordered_map<std::string, CitationPtr> loadWithDom(const std::string& filename) {
+    // the original loader: a full DOM, then one map node and one shared_ptr per citation
+    std::ifstream file{filename};
+    nlohmann::json data = nlohmann::json::parse(file)["citations"];
+    std::unordered_map<std::string, CitationPtr> citations;
+    for (auto& item : data) {
+        std::string type = item["type"].get<std::string>();
+        std::string id = item["id"].get<std::string>();
+        if (type == "book") {
+            citations[id] = std::make_shared<Book>(item);
+        } else if (type == "webpage") {
+            citations[id] = std::make_shared<WebPage>(item);
+        } else {
+            citations[id] = std::make_shared<Article>(item);
+        }
+    }
+    return citations;
+}
+
+static std::string sizeLabel(size_t mib) {
+    return mib % 1024 == 0 ? std::to_string(mib / 1024) + "GiB" : std::to_string(mib) + "MiB";
+}
+
+static std::string entriesLabel(size_t entries) {
+    return entries % 1000000 == 0 ? std::to_string(entries / 1000000) + "M"
+         : entries % 1000 == 0 ? std::to_string(entries / 1000) + "K" : std::to_string(entries);
+}
+
+// the line-by-line scan baselines are only run on larger documents with `--full`
+static size_t scanBaselineMaxMib = 64;
+
+static void benchScan(size_t mib, size_t threads) {
+    /*
+    The two halves of `outputCitations` on a document of `mib` MiB: scanning it for
+    citation IDs and writing it out.
+    */
+    std::string doc = makeDocument(mib << 20);
+    std::string suffix = "/" + sizeLabel(mib);
+    if (mib <= scanBaselineMaxMib) {
+        bench("scan/regex" + suffix, doc.size(), [&]() { scanWithRegex(doc); });
+        bench("scan/scanner" + suffix, doc.size(), [&]() { scanWithScanner(doc); });
+    }
+
+    std::pair<const char*, ScanKernel> kernels[] = {
+        {"scan/block-scalar", ScanKernel::Scalar},
+        {"scan/block-sse2", ScanKernel::SSE2},
+        {"scan/block-avx2", ScanKernel::AVX2},
+    };
+    for (auto& [name, kernel] : kernels) {
+        if (CitationScanner::supported(kernel)) {
+            bench(name + suffix, doc.size(), [&, kernel = kernel]() { scanBlock(doc, kernel); });
+        }
+    }
+    bench("scan/parallel" + suffix, doc.size(), [&]() { scanParallel(doc, threads); });
+
+    bench("output/endl" + suffix, doc.size(), [&]() { writeWithEndl(doc); });
+    bench("output/buffered" + suffix, doc.size(), [&]() { writeBuffered(doc); });
+}
+
+static void benchLoad(size_t entries, bool lookups, size_t threads) {
+    /*
+    Load a synthetic citations file of `entries` entries with the original loader and with
+    `loadCitations`, the latter building its table on one thread and on `threads`, and if
+    `lookups` is set, compare looking IDs up in the results.
+    */
+    std::string dbFile = (std::filesystem::temp_directory_path() / "docman_bench_citations.json").string();
+    std::string db = makeDatabase(entries);
+    std::ofstream{dbFile} << db;
+    std::string suffix = "/" + entriesLabel(entries);
+
+    bench("load/dom+unordered_map" + suffix, db.size(), [&]() { loadWithDom(dbFile); });
+    bench("load/sax+table-1thread" + suffix, db.size(), [&]() { loadCitations(dbFile, nullptr, 1); });
+    bench("load/sax+table" + suffix, db.size(), [&]() { loadCitations(dbFile, nullptr, threads); });
+    countAllocations("alloc/dom+unordered_map" + suffix, entries, [&]() { loadWithDom(dbFile); });
+    countAllocations("alloc/sax+table" + suffix, entries, [&]() { loadCitations(dbFile); });
+
+    if (lookups) {
+        auto map = loadWithDom(dbFile);
+        auto table = loadCitations(dbFile);
+        std::vector<std::string> ids;
+        std::mt19937 rng{42};
+        for (size_t i = 0; i < 1000000; i++) {
+            ids.push_back("ref" + std::to_string(rng() % (entries + entries / 10)));
+        }
+        size_t found = 0;
+        bench("lookup/unordered_map" + suffix, ids.size(), "lookups", [&]() {
+            for (auto& id : ids) {
+                found += map.count(id);
+            }
+        });
+        bench("lookup/table" + suffix, ids.size(), "lookups", [&]() {
+            for (auto& id : ids) {
+                found += table.find(id) != nullptr;
+            }
+        });
+        if (found == 0) {
+            std::cerr << "no citation was found" << std::endl;
+        }
+    }
+    std::filesystem::remove(dbFile);
+}
+
+// exposes the rendering `Article::toString` memoizes, so it can be measured repeatedly
+struct BenchArticle : Article {
+    using Article::Article;
+
+    std::string renderAgain() const {
+        return render();
+    }
+};
+
+static void benchRenderArticles() {
+    std::vector<BenchArticle> articles;
+    articles.reserve(10000);
+    for (int i = 0; i < 10000; i++) {
+        articles.emplace_back(
+            "ref" + std::to_string(i), "A Study of Citation Number " + std::to_string(i),
+            "Author " + std::to_string(i % 100), "Journal of Benchmarks", 2000 + i % 25, i % 40, i % 12, true
+        );
+    }
+    size_t renderedBytes = 0;
+    bench("render/article", articles.size(), "items", [&]() {
+        for (auto& article : articles) {
+            renderedBytes += article.renderAgain().size();
+        }
+    });
+}
+
+template <typename T>
+static void benchRenderFromWeb(const std::string& name, const std::string& prefix, bool batch, size_t threads) {
+    /*
+    Render 256 citations of type `T` the way `renderAll` does: prefetch, start all lookups,
+    wait for them, then render. Every run uses keys never fetched before, so each one goes
+    to the server.
+    */
+    static size_t run = 0;
+    const size_t count = 256;
+    bench(name, count, "items", [&]() {
+        std::vector<T> citations;
+        std::vector<std::string> resources;
+        citations.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            citations.emplace_back("ref" + std::to_string(i), prefix + std::to_string(run) + "-" + std::to_string(i));
+            resources.push_back(citations.back().getResourcePath());
+        }
+        ++run;
+        if (batch) {
+            prefetchFromWeb(resources);
+        }
+        std::vector<std::shared_future<std::string>> lookups;
+        for (auto& citation : citations) {
+            lookups.push_back(citation.getResourceAsync());
+        }
+        for (auto& lookup : lookups) {
+            lookup.wait();
+        }
+        parallelFor(citations.size(), threads, [&](size_t i) { citations[i].toString(); });
+    });
+}
+
+static bool batchesOnce() {
+    /*
+    Render the same books twice, the way `renderAll` does for every request of `docman
+    serve`: the second time, everything is already in memory, so no batch request may be
+    sent again.
+    */
+    std::vector<Book> books;
+    std::vector<std::string> resources;
+    for (size_t i = 0; i < 16; i++) {
+        books.emplace_back("ref" + std::to_string(i), "978-repeat-" + std::to_string(i));
+        resources.push_back(books.back().getResourcePath());
+    }
+    size_t before = 0;
+    for (int render = 0; render < 2; render++) {
+        if (render == 1) {
+            before = getWebStats().batchRequests;
+        }
+        prefetchFromWeb(resources);
+        for (auto& book : books) {
+            book.getResourceAsync().wait();
+        }
+    }
+    return getWebStats().batchRequests == before;
+}
+
+static bool benchRenderFromWeb(size_t threads) {
+    /*
+    Render books and webpages against the stand-in API, served from this process on a
+    free local port, with and without batch requests. Returns false if a repeated render
+    sends batch requests again.
+    */
+    httplib::Server server;
+    installMockApi(server);
+    int port = server.bind_to_any_port("127.0.0.1");
+    if (port < 0) {
+        std::cerr << "cannot start the mock API, skipping the web cases" << std::endl;
+        return true;
+    }
+    std::thread listener{[&]() { server.listen_after_bind(); }};
+    server.wait_until_ready();
+
+    WebOptions options;
+    options.endpoint = "http://127.0.0.1:" + std::to_string(port);
+    options.concurrency = threads;
+    configureWeb(options);
+    benchRenderFromWeb<Book>("render/book", "978-", false, threads);
+    benchRenderFromWeb<WebPage>("render/webpage", "https://example.com/", false, threads);
+
+    options.batchPath = "/batch";
+    configureWeb(options);
+    bool repeatBatched = !batchesOnce();
+    benchRenderFromWeb<Book>("render/book+batch", "978-", true, threads);
+    benchRenderFromWeb<WebPage>("render/webpage+batch", "https://example.com/", true, threads);
+
+    server.stop();
+    listener.join();
+    if (repeatBatched) {
+        std::cerr << "a repeated render sent batch requests again" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string jsonFile;
+    size_t mib = 4;
+    size_t entries = 100000;
+    std::vector<std::string> sizes;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if (arg == "--full") {
+            mib = 1024;
+            entries = 1000000;
+            scanBaselineMaxMib = SIZE_MAX;
+        } else {
+            sizes.push_back(arg);
+        }
+    }
+    if (sizes.size() > 0) {
+        mib = std::strtoul(sizes[0].c_str(), nullptr, 10);
+    }
+    if (sizes.size() > 1) {
+        entries = std::strtoul(sizes[1].c_str(), nullptr, 10);
+    }
+    if (sizes.size() > 2 || mib == 0 || entries == 0) {
+        std::cerr << "usage: docman_bench [--json FILE] [--full] [document MiB] [database entries]" << std::endl;
+        return 1;
+    }
+
+    // check the scanners on a document of up to 16 MiB, large enough to be scanned in parallel chunks
+    std::string doc = makeDocument(std::min<size_t>(mib, 16) << 20);
+    if (scanWithRegex(doc) != scanWithScanner(doc) || scanWithRegex(doc) != scanBlock(doc, ScanKernel::Auto)) {
+        std::cerr << "scanner and regex disagree" << std::endl;
+        return 1;
+    }
+
+    // include a document that goes negative in its middle and one that ends unbalanced
+    size_t middle = doc.find('\n', doc.size() / 2) + 1;
+    std::string negativeDoc = doc.substr(0, middle) + "]\n[\n" + doc.substr(middle);
+    std::string unbalancedDoc = doc + "[x\n";
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    for (auto* text : {&doc, &negativeDoc, &unbalancedDoc}) {
+        if (!sameScan(*text, threads) || !sameScan(*text, 3)) {
+            std::cerr << "parallel and sequential scans disagree" << std::endl;
+            return 1;
+        }
+    }
+    doc.clear();
+    doc.shrink_to_fit();
+    negativeDoc.clear();
+    negativeDoc.shrink_to_fit();
+    unbalancedDoc.clear();
+    unbalancedDoc.shrink_to_fit();
+
+    for (size_t size : {size_t{1}, mib}) {
+        benchScan(size, threads);
+        if (mib == 1) {
+            break;
+        }
+    }
+
+    if (encodeUriComponent("a b/\xc3\xbc~") != "a+b%2F%C3%BC~" || encodeUriComponent(std::string("\x01", 1)) != "%01") {
+        std::cerr << "encodeUriComponent is wrong" << std::endl;
+        return 1;
+    }
+    auto urls = makeUrls(10000);
+    size_t urlBytes = 0;
+    for (auto& url : urls) {
+        urlBytes += url.size();
+    }
+    size_t encodedBytes = 0;
+    bench("encode/stringstream", urlBytes, [&]() {
+        for (auto& url : urls) {
+            encodedBytes += encodeWithStringstream(url).size();
+        }
+    });
+    bench("encode/table", urlBytes, [&]() {
+        for (auto& url : urls) {
+            encodedBytes += encodeUriComponent(url).size();
+        }
+    });
+
+    // check the parallel table build against adding one citation after another
+    for (size_t n : {size_t{1}, size_t{3}, size_t{4}, size_t{16}, threads}) {
+        if (!sameBulkLoad(n, false) || !sameBulkLoad(n, true)) {
+            std::cerr << "bulk and sequential table builds disagree" << std::endl;
+            return 1;
+        }
+    }
+
+    for (size_t size : {size_t{10000}, entries}) {
+        benchLoad(size, size == entries, threads);
+        if (entries == 10000) {
+            break;
+        }
+    }
+
+    benchRenderArticles();
+    if (!benchRenderFromWeb(threads)) {
+        return 1;
+    }
+
+    if (!jsonFile.empty()) {
+        nlohmann::json report = {
+            {"context", {
+                {"document_mib", mib},
+                {"database_entries", entries},
+                {"threads", threads},
+                {"time", std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count()}
+            }},
+            {"benchmarks", results}
+        };
+        std::ofstream output{jsonFile};
+        output << report.dump(2) << '\n';
+        if (!output) {
+            std::cerr << "cannot write " << jsonFile << std::endl;
+            return 1;
+        }
+    }
+}
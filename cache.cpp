@@ -0,0 +1,147 @@
+#include "./cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static long long now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+DiskCache::DiskCache(const std::string& dir, long long ttl, std::uintmax_t maxBytes)
+    : dir(dir), ttl(ttl), maxBytes(maxBytes) {
+    /*
+    This function is used to open (and create if needed) a cache directory.
+    The size of the existing entries is counted once here and tracked from then on.
+    */
+    std::error_code ec;
+    fs::create_directories(this->dir, ec);
+    if (!fs::is_directory(this->dir, ec)) {
+        std::exit(1);
+    }
+    for (auto& entry : fs::directory_iterator(this->dir, ec)) {
+        if (entry.is_regular_file(ec)) {
+            totalBytes += entry.file_size(ec);
+        }
+    }
+}
+
+bool DiskCache::enabled() const {
+    return !dir.empty();
+}
+
+fs::path DiskCache::pathFor(const std::string& key) const {
+    // 64-bit FNV-1a hash of the key
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    std::stringstream name;
+    name << std::hex << hash << ".entry";
+    return dir / name.str();
+}
+
+std::optional<std::string> DiskCache::get(const std::string& key) const {
+    /*
+    This function is used to look up a cached response.
+    It returns nothing if the entry is missing, belongs to another key or has expired.
+    */
+    if (!enabled()) {
+        return std::nullopt;
+    }
+
+    std::ifstream file{pathFor(key), std::ios::binary};
+    std::string storedKey, storedTime;
+    if (!std::getline(file, storedKey) || !std::getline(file, storedTime) || storedKey != key) {
+        return std::nullopt;
+    }
+
+    long long time = 0;
+    try {
+        time = std::stoll(storedTime);
+    } catch (...) {
+        return std::nullopt;
+    }
+    if (now() - time > ttl) {
+        return std::nullopt;
+    }
+
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void DiskCache::put(const std::string& key, const std::string& value) {
+    /*
+    This function is used to store a response in the cache.
+    The entry is written to a temporary file first and renamed into place, so readers
+    (including other docman processes) never see a half-written entry. Failing to write
+    the cache is not an error, the response is simply not cached.
+    */
+    if (!enabled() || key.find('\n') != std::string::npos) {
+        return;
+    }
+
+    fs::path target = pathFor(key);
+    std::stringstream tmpName;
+    tmpName << target.filename().string() << ".tmp." << std::random_device{}() << "." << std::this_thread::get_id();
+    fs::path tmp = dir / tmpName.str();
+    {
+        std::ofstream file{tmp, std::ios::binary};
+        file << key << '\n' << now() << '\n' << value;
+        if (!file) {
+            return;
+        }
+    }
+
+    std::error_code ec;
+    auto oldSize = fs::file_size(target, ec);
+    if (ec) {
+        oldSize = 0;
+    }
+    fs::rename(tmp, target, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{mutex};
+    totalBytes = totalBytes - std::min(totalBytes, oldSize) + fs::file_size(target, ec);
+    if (totalBytes > maxBytes) {
+        evict();
+    }
+}
+
+void DiskCache::evict() {
+    /*
+    This function is used to remove the least recently written entries until the cache
+    is back under 3/4 of its size limit. The caller must hold `mutex`.
+    */
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> entries;
+    totalBytes = 0;
+    for (auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file(ec)) {
+            entries.emplace_back(entry.last_write_time(ec), entry.path());
+            totalBytes += entry.file_size(ec);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    for (auto& [time, path] : entries) {
+        if (totalBytes <= maxBytes / 4 * 3) {
+            break;
+        }
+        auto size = fs::file_size(path, ec);
+        if (!ec && fs::remove(path, ec)) {
+            totalBytes -= std::min(totalBytes, size);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+
+class DiskCache {
+/*
+A persistent cache of web responses, stored as one file per key in a directory.
+
+Keys are the request paths (e.g. "/isbn/<encoded>"), the file name is a hash of the key
+and the file itself starts with the key and the time it was stored, so hash collisions
+and expired entries are detected on read. Entries older than `ttl` seconds are ignored,
+and the oldest entries are evicted once the directory grows beyond `maxBytes`.
+A default-constructed cache is disabled and never stores anything.
+*/
+
+private:
+    std::filesystem::path dir;
+    long long ttl = 0;
+    std::uintmax_t maxBytes = 0;
+    std::uintmax_t totalBytes = 0;
+    std::mutex mutex;
+
+    std::filesystem::path pathFor(const std::string& key) const;
+    void evict();
+public:
+    DiskCache() = default;
+    DiskCache(const std::string& dir, long long ttl, std::uintmax_t maxBytes);
+
+    bool enabled() const;
+    std::optional<std::string> get(const std::string& key) const;
+    void put(const std::string& key, const std::string& value);
+};
+
+#endif
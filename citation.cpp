@@ -1,102 +1,153 @@
 #include "./citation.h"
+#include "./index.h"
 #include "./utils.hpp"
-
-std::string getFromWeb(const std::string& resource) {
-    /*
-    This function is used to get some information from the web.
-    */
-    httplib::Client client{API_ENDPOINT};
-    auto res = client.Get(resource);
-    if (res && res->status == httplib::OK_200) {
-        return res->body;
-    } else {
-        std::exit(1);
-        return std::string();
-    } 
-}
+#include "./web.h"
 
 // Citation class
 
-Citation::Citation(const nlohmann::json& data) {
+Citation::Citation(const nlohmann::json& data, std::pmr::memory_resource* resource) : id(resource) {
     /*
     This function is used to initialize a citation.
     */
     if (!data.contains("id")) {
-        std::exit(1);
+        fail("citation without an id");
     }
-    id = data["id"].get<std::string>();
-    this->data = data;
+    id = data["id"].get_ref<const std::string&>();
 }
 
+Citation::Citation(std::string_view id, std::pmr::memory_resource* resource) : id(id, resource) {}
+
 std::string Citation::getResource() const {
-    std::exit(1);
+    fail("citation has no web resource");
+}
+
+std::shared_future<std::string> Citation::getResourceAsync() const {
+    std::promise<std::string> resource;
+    resource.set_value(getResource());
+    return resource.get_future().share();
+}
+
+std::string Citation::getResourcePath() const {
+    return std::string();
+}
+
+Citation::Citation(Citation&& other) noexcept : id(std::move(other.id)) {}
+
+Citation& Citation::operator=(Citation&& other) noexcept {
+    id = std::move(other.id);
+    return *this;
 }
 
-std::string Citation::toString() const {
-    return std::string("[" + id + "] ");
+std::string_view Citation::getId() const {
+    return id;
+}
+
+void Citation::addToIndex(IndexBuilder&) const {
+    fail("citation cannot be indexed");
+}
+
+std::string Citation::render() const {
+    return std::string("[" + std::string(id) + "] ");
+}
+
+const std::string& Citation::toString() const {
+    /*
+    This function is used to describe a citation.
+    The description is rendered on first use, at most once even when several threads ask
+    for it at the same time, and the same string is returned afterwards.
+    */
+    std::call_once(renderOnce, [this]() { rendered = render(); });
+    return rendered;
 }
 
 // Article class
 
-Article::Article(const nlohmann::json& data) : Citation(data) {
+Article::Article(const nlohmann::json& data, std::pmr::memory_resource* resource)
+    : Citation(data, resource), title(resource), author(resource), journal(resource) {
     /*
     This function is used to initialize an article.
+    The fields are read once here. If they do not have the types `render` needs, the
+    article is still created, but rendering it fails.
     */
     if (!data.contains("journal") || !data.contains("year") || !data.contains("volume") || !data.contains("issue")) {
-        std::exit(1);
+        fail("article " + std::string(id) + " lacks journal, year, volume or issue");
+    }
+
+    renderable =
+        data.contains("title") &&
+        data.contains("author") &&
+        data["title"].is_string() &&
+        data["author"].is_string() &&
+        data["journal"].is_string() &&
+        data["year"].is_number() &&
+        data["volume"].is_number() &&
+        data["issue"].is_number();
+    if (renderable) {
+        title       =    data["title"].get_ref<const std::string&>();
+        author      =    data["author"].get_ref<const std::string&>();
+        journal     =    data["journal"].get_ref<const std::string&>();
+        year        =    data["year"].get<int>();
+        volume      =    data["volume"].get<int>();
+        issue       =    data["issue"].get<int>();
     }
 }
 
+Article::Article(
+    std::string_view id,
+    std::string_view title,
+    std::string_view author,
+    std::string_view journal,
+    int year,
+    int volume,
+    int issue,
+    bool renderable,
+    std::pmr::memory_resource* resource
+) : Citation(id, resource),
+    title(title, resource),
+    author(author, resource),
+    journal(journal, resource),
+    year(year),
+    volume(volume),
+    issue(issue),
+    renderable(renderable) {}
+
 std::string Article::getResource() const {
-    std::exit(1);
+    fail("citation has no web resource");
 }
 
-std::string Article::toString() const {
+void Article::addToIndex(IndexBuilder& builder) const {
     /*
-    This function is used to describe an article.
+    This function is used to store an article in a citation index.
     */
-    auto info = data;
+    builder.addArticle(id, title, author, journal, year, volume, issue, renderable);
+}
 
-    if (data.is_null()) {
-        std::exit(1);
-    }
-    if (info.contains("title") &&
-        info.contains("author") &&
-        info.contains("journal") &&
-        info.contains("year") &&
-        info.contains("volume") &&
-        info.contains("issue") &&        
-        info["title"].is_string() && 
-        info["author"].is_string() && 
-        info["journal"].is_string() && 
-        info["year"].is_number() && 
-        info["volume"].is_number() && 
-        info["issue"].is_number()) 
-    {        
-        std::string title       =    info["title"].get<std::string>();
-        std::string author      =    info["author"].get<std::string>();
-        std::string journal     =    info["journal"].get<std::string>();
-        std::string year        =    std::to_string(info["year"].get<int>());
-        std::string volume      =    std::to_string(info["volume"].get<int>());
-        std::string issue       =    std::to_string(info["issue"].get<int>());
-        return std::string(
-            "[" + id + "] article: " + author + ", " + title + ", " + journal + ", " + year + ", " + volume + ", " + issue
-        );
-    } else {
-        std::exit(1);
+std::string Article::render() const {
+    /*
+    This function is used to describe an article.
+    */
+    if (!renderable) {
+        fail("article " + std::string(id) + " cannot be rendered");
     }
+    return std::string(
+        "[" + std::string(id) + "] article: " + std::string(author) + ", " + std::string(title) + ", " + std::string(journal) + ", " +
+        std::to_string(year) + ", " + std::to_string(volume) + ", " + std::to_string(issue)
+    );
 }
 
 // Book class
 
-Book::Book(const nlohmann::json& data) : Citation(data) {
+Book::Book(std::string_view id, std::string_view isbn, std::pmr::memory_resource* resource)
+    : Citation(id, resource), isbn(isbn, resource) {}
+
+Book::Book(const nlohmann::json& data, std::pmr::memory_resource* resource) : Citation(data, resource), isbn(resource) {
     /*
     This function is used to initialize a book.
     */
     if (!data.contains("isbn") || !data["isbn"].is_string()) {
-        std::exit(1);
+        fail("book " + std::string(id) + " has no isbn");
     }
-    isbn = data["isbn"].get<std::string>();
+    isbn = data["isbn"].get_ref<const std::string&>();
 }
 
 std::string Book::getResource() const {
@@ -105,18 +156,27 @@ std::string Book::getResource() const {
     It sends a GET request to the API with the ISBN of the book.
     If the response is OK (HTTP 200), it processes the response.
     */
-    return getFromWeb("/isbn/" + encodeUriComponent(isbn));
+    return getFromWeb(getResourcePath());
+}
+
+std::shared_future<std::string> Book::getResourceAsync() const {
+    return getFromWebAsync(getResourcePath());
 }
 
-std::string Book::toString() const {
+std::string Book::getResourcePath() const {
+    return "/isbn/" + encodeUriComponent(isbn);
+}
+
+void Book::addToIndex(IndexBuilder& builder) const {
+    builder.addBook(id, isbn);
+}
+
+std::string Book::render() const {
     /*
     This function is used to describe a book.
     */
     nlohmann::json info = nlohmann::json::parse(getResource());
 
-    if (data.is_null()) {
-        std::exit(1);
-    }
     if (info.contains("author") &&
         info.contains("title") &&
         info.contains("publisher") &&
@@ -131,22 +191,25 @@ std::string Book::toString() const {
         std::string publisher   =    info["publisher"].get<std::string>();
         std::string year        =    info["year"].get<std::string>();
 
-        return std::string("[" + id + "] book: " + author + ", " + title + ", " + publisher + ", " + year);
+        return std::string("[" + std::string(id) + "] book: " + author + ", " + title + ", " + publisher + ", " + year);
     } else {
-        std::exit(1);
+        fail("unexpected metadata for book " + std::string(id));
     }
 }
 
 // WebPage class
 
-WebPage::WebPage(const nlohmann::json& data) : Citation(data) {
+WebPage::WebPage(std::string_view id, std::string_view url, std::pmr::memory_resource* resource)
+    : Citation(id, resource), url(url, resource) {}
+
+WebPage::WebPage(const nlohmann::json& data, std::pmr::memory_resource* resource) : Citation(data, resource), url(resource) {
     /*
     This function is used to initialize a webpage.
     */
     if (!data.contains("url") || !data["url"].is_string()) {
-        std::exit(1);
+        fail("webpage " + std::string(id) + " has no url");
     }
-    url = data["url"].get<std::string>();
+    url = data["url"].get_ref<const std::string&>();
 }
 
 std::string WebPage::getResource() const {
@@ -155,23 +218,32 @@ std::string WebPage::getResource() const {
     It sends a GET request to the API with the URL of the website.
     If the response is OK (HTTP 200), it processes the response.
     */
-    return getFromWeb("/title/" + encodeUriComponent(url));
+    return getFromWeb(getResourcePath());
 }
 
-std::string WebPage::toString() const {
+std::shared_future<std::string> WebPage::getResourceAsync() const {
+    return getFromWebAsync(getResourcePath());
+}
+
+std::string WebPage::getResourcePath() const {
+    return "/title/" + encodeUriComponent(url);
+}
+
+void WebPage::addToIndex(IndexBuilder& builder) const {
+    builder.addWebPage(id, url);
+}
+
+std::string WebPage::render() const {
     /*
     This function is used to describe a webpage.
     */
     nlohmann::json info = nlohmann::json::parse(getResource());
 
-    if (data.is_null()) {
-        std::exit(1);
-    }
     if (info.contains("title") && info["title"].is_string()) {
         std::string title = info["title"].get<std::string>();
-        return std::string("[" + id + "] webpage: " + title + ". Available at " + url);
+        return std::string("[" + std::string(id) + "] webpage: " + title + ". Available at " + std::string(url));
     } else {
-        std::exit(1);
+        fail("unexpected metadata for webpage " + std::string(id));
     }
     
 }
\ No newline at end of file
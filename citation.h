@@ -2,34 +2,65 @@
 #define CITATION_H
 
 #include <fstream>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
+#include <string_view>
 
-#include "cpp-httplib/httplib.h"
 #include "nlohmann/json.hpp"
 
 class Citation;
+class IndexBuilder;
 using CitationPtr = std::shared_ptr<Citation>;
 
 class Citation {
 /*
 Base class for all citations.
 
-This class stores the ID and data of a citation. The data is stored as a JSON object.
-Derived classes should override the `getResource` and `toString` methods to provide
+This class stores the ID of a citation, derived classes store the fields of their type.
+Derived classes should override the `getResource` and `render` methods to provide
 behavior to fetch the citation resource and to convert the citation to a string, respectively.
+`toString` renders the citation on first use and returns the same string afterwards.
+`getResourceAsync` starts fetching the resource and returns a future for it, so that the
+lookups of many citations can be in flight at once; by default it calls `getResource`.
+`getResourcePath` returns the web resource `getResource` fetches, or an empty string if
+the citation needs none, so that lookups can be batched up front (see `prefetchFromWeb`).
+`addToIndex` stores the citation in a compiled citation index (see index.h).
+
+Citations can be moved (e.g. while a `CitationTable` is being filled) but not copied.
+Moving does not carry over the rendered string, so a citation should not be moved once
+it may have been rendered.
+
+Citations are constructed either from the JSON object of a citations file entry, whose
+fields are read once and checked, or directly from typed fields (e.g. from a compiled
+index). The strings a citation keeps are allocated from the memory resource given to the
+constructor, typically the arena of the `CitationTable` it is added to.
 */
 
 protected:
-    std::string id;
-    nlohmann::json data;
+    std::pmr::string id;
+
+    virtual std::string render() const;
+private:
+    mutable std::once_flag renderOnce;
+    mutable std::string rendered;
 public:
     virtual ~Citation() = default;
 
     Citation() = default;
-    Citation(const nlohmann::json& data);
+    Citation(const nlohmann::json& data, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    Citation(std::string_view id, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    Citation(Citation&& other) noexcept;
+    Citation& operator=(Citation&& other) noexcept;
 
+    std::string_view getId() const;
     virtual std::string getResource() const;
-    virtual std::string toString() const;
+    virtual std::shared_future<std::string> getResourceAsync() const;
+    virtual std::string getResourcePath() const;
+    virtual void addToIndex(IndexBuilder& builder) const;
+    const std::string& toString() const;
 };
 
 class Book : public Citation {
@@ -37,20 +68,27 @@ class Book : public Citation {
 This class represents a book citation.
 
 In addition to the base class fields, this class also stores the ISBN of the book.
-The `getResource` method returns the ISBN, and the `toString` method returns a string
+The `getResource` method returns the ISBN, and the `render` method returns a string
 representation of the citation in the format expected for book citations.
 */
 
 private:
-    std::string isbn;
+    std::pmr::string isbn;
 public:
     ~Book() override = default;
 
     Book() = default;
-    Book(const nlohmann::json& data);
+    Book(const nlohmann::json& data, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    Book(std::string_view id, std::string_view isbn, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    Book(Book&&) = default;
+    Book& operator=(Book&&) = default;
 
     std::string getResource() const override;
-    std::string toString() const override;
+    std::shared_future<std::string> getResourceAsync() const override;
+    std::string getResourcePath() const override;
+    void addToIndex(IndexBuilder& builder) const override;
+protected:
+    std::string render() const override;
 };
 
 class WebPage : public Citation {
@@ -58,39 +96,70 @@ class WebPage : public Citation {
 This class represents a webpage citation.
 
 In addition to the base class fields, this class also stores the URL of the webpage.
-The `getResource` method returns the URL, and the `toString` method returns a string
+The `getResource` method returns the URL, and the `render` method returns a string
 representation of the citation in the format expected for webpage citations.
 */
 
 private:
-    std::string url;
+    std::pmr::string url;
 public:
     ~WebPage() override = default;
 
     WebPage() = default;
-    WebPage(const nlohmann::json& data);
+    WebPage(const nlohmann::json& data, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    WebPage(std::string_view id, std::string_view url, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    WebPage(WebPage&&) = default;
+    WebPage& operator=(WebPage&&) = default;
 
     std::string getResource() const override;
-    std::string toString() const override;
+    std::shared_future<std::string> getResourceAsync() const override;
+    std::string getResourcePath() const override;
+    void addToIndex(IndexBuilder& builder) const override;
+protected:
+    std::string render() const override;
 };
 
 class Article : public Citation {
 /*
 This class represents an article citation.
 
-This class does not add any new fields to the base class. The `getResource` method
-returns an empty string, and the `toString` method returns a string representation
-of the citation in the format expected for article citations.
+In addition to the base class fields, this class stores the title, author, journal,
+year, volume and issue of the article, and whether they have the types needed to render
+it. The `getResource` method is not supported, and the `render` method returns a string
+representation of the citation in the format expected for article citations.
 */
 
+private:
+    std::pmr::string title;
+    std::pmr::string author;
+    std::pmr::string journal;
+    int year = 0;
+    int volume = 0;
+    int issue = 0;
+    bool renderable = false;
 public:
     ~Article() override = default;
 
     Article() = default;
-    Article(const nlohmann::json& data);
+    Article(const nlohmann::json& data, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    Article(
+        std::string_view id,
+        std::string_view title,
+        std::string_view author,
+        std::string_view journal,
+        int year,
+        int volume,
+        int issue,
+        bool renderable,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+    );
+    Article(Article&&) = default;
+    Article& operator=(Article&&) = default;
 
     std::string getResource() const override;
-    std::string toString() const override;
+    void addToIndex(IndexBuilder& builder) const override;
+protected:
+    std::string render() const override;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "./citation_table.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "./utils.hpp"
+
+// CitationTable class
+
+static std::uint64_t hashId(std::string_view id) {
+    return std::hash<std::string_view>{}(id);
+}
+
+CitationTable::CitationTable()
+    : arena(std::make_unique<std::pmr::monotonic_buffer_resource>(64 << 10)) {}
+
+CitationTable& CitationTable::operator=(CitationTable&& other) noexcept {
+    /*
+    This function is used to replace the contents of a table with another one's.
+    The current citations are destroyed first, while the arena their strings were
+    allocated from still exists, and only then is the arena replaced.
+    */
+    if (this != &other) {
+        clear();
+        books = std::move(other.books);
+        webPages = std::move(other.webPages);
+        articles = std::move(other.articles);
+        slots = std::move(other.slots);
+        count = std::exchange(other.count, 0);
+        bulk = std::exchange(other.bulk, false);
+        pending = std::move(other.pending);
+        arena = std::move(other.arena);
+    }
+    return *this;
+}
+
+std::pmr::memory_resource* CitationTable::resource() const {
+    return arena.get();
+}
+
+const Citation* CitationTable::at(const Slot& slot) const {
+    switch (slot.type) {
+    case BOOK:
+        return &books[slot.index];
+    case WEBPAGE:
+        return &webPages[slot.index];
+    case ARTICLE:
+        return &articles[slot.index];
+    default:
+        return nullptr;
+    }
+}
+
+void CitationTable::insert(std::uint64_t hash, Type type, std::uint32_t index) {
+    /*
+    This function is used to point the slot of an ID at a stored citation.
+    If the ID is already in the table, its slot is reused and the older citation is no
+    longer reachable.
+    */
+    if ((count + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    std::string_view id = at(Slot{hash, type, index})->getId();
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (slot.type == EMPTY) {
+            slot = Slot{hash, type, index};
+            ++count;
+            return;
+        }
+        if (slot.hash == hash && at(slot)->getId() == id) {
+            slot = Slot{hash, type, index};
+            return;
+        }
+    }
+}
+
+void CitationTable::grow() {
+    /*
+    This function is used to double the number of slots (keeping it a power of two).
+    */
+    resize(std::max<size_t>(16, slots.size() * 2));
+}
+
+void CitationTable::resize(size_t size) {
+    /*
+    This function is used to change the number of slots to `size`, a power of two, and
+    to re-insert every used slot with its stored hash.
+    */
+    std::vector<Slot> old(size, Slot{0, EMPTY, 0});
+    old.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (auto& slot : old) {
+        if (slot.type == EMPTY) {
+            continue;
+        }
+        size_t i = slot.hash & mask;
+        while (slots[i].type != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
+
+void CitationTable::stored(Type type, size_t index) {
+    if (bulk) {
+        pending.push_back(Pending{type, static_cast<std::uint32_t>(index)});
+    } else {
+        insert(hashId(at(Slot{0, type, static_cast<std::uint32_t>(index)})->getId()), type, static_cast<std::uint32_t>(index));
+    }
+}
+
+void CitationTable::add(Book citation) {
+    books.push_back(std::move(citation));
+    stored(BOOK, books.size() - 1);
+}
+
+void CitationTable::add(WebPage citation) {
+    webPages.push_back(std::move(citation));
+    stored(WEBPAGE, webPages.size() - 1);
+}
+
+void CitationTable::add(Article citation) {
+    articles.push_back(std::move(citation));
+    stored(ARTICLE, articles.size() - 1);
+}
+
+void CitationTable::clear() {
+    books.clear();
+    webPages.clear();
+    articles.clear();
+    slots.clear();
+    pending.clear();
+    count = 0;
+    arena->release();
+}
+
+void CitationTable::beginBulk() {
+    bulk = true;
+}
+
+void CitationTable::endBulk(size_t threads) {
+    /*
+    This function is used to insert everything added since `beginBulk` (see the class
+    comment). The table can be searched again afterwards.
+    */
+    bulk = false;
+    std::vector<Pending> added;
+    added.swap(pending);
+    if (added.empty()) {
+        return;
+    }
+    if (count > 0) {
+        // shards only see their own slots, so IDs that are already in the table and were
+        // pushed into a neighbouring shard would be missed; insert one after another
+        for (auto& entry : added) {
+            insert(hashId(at(Slot{0, entry.type, entry.index})->getId()), entry.type, entry.index);
+        }
+        return;
+    }
+
+    size_t size = 16;
+    while (size < (count + added.size()) * 2) {
+        size *= 2;
+    }
+    if (size > slots.size()) {
+        resize(size);
+    }
+    size_t mask = slots.size() - 1;
+
+    // a handful of shards per thread, each at least a few thousand slots
+    size_t shards = 1;
+    while (shards < std::max<size_t>(threads, 1) * 4 && slots.size() / (shards * 2) >= 4096) {
+        shards *= 2;
+    }
+    size_t shardSize = slots.size() / shards;
+    threads = std::min(std::max<size_t>(threads, 1), shards);
+
+    std::vector<std::uint64_t> hashes(added.size());
+    size_t perThread = (added.size() + threads - 1) / threads;
+    parallelFor(threads, threads, [&](size_t t) {
+        for (size_t i = t * perThread; i < std::min(added.size(), (t + 1) * perThread); i++) {
+            hashes[i] = hashId(at(Slot{0, added[i].type, added[i].index})->getId());
+        }
+    });
+
+    // group the additions by shard, keeping their order within each shard
+    std::vector<size_t> offsets(shards + 1, 0);
+    for (auto hash : hashes) {
+        ++offsets[(hash & mask) / shardSize + 1];
+    }
+    for (size_t k = 0; k < shards; k++) {
+        offsets[k + 1] += offsets[k];
+    }
+    std::vector<std::uint32_t> order(added.size());
+    {
+        std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < added.size(); i++) {
+            order[next[(hashes[i] & mask) / shardSize]++] = static_cast<std::uint32_t>(i);
+        }
+    }
+
+    std::vector<size_t> inserted(shards, 0);
+    std::vector<std::vector<std::uint32_t>> overflow(shards);
+    parallelFor(shards, threads, [&](size_t k) {
+        size_t end = (k + 1) * shardSize;
+        for (size_t o = offsets[k]; o < offsets[k + 1]; o++) {
+            size_t i = order[o];
+            Slot entry{hashes[i], added[i].type, added[i].index};
+            std::string_view id = at(entry)->getId();
+            size_t s = entry.hash & mask;
+            for (; s < end; s++) {
+                Slot& slot = slots[s];
+                if (slot.type == EMPTY) {
+                    slot = entry;
+                    ++inserted[k];
+                    break;
+                }
+                if (slot.hash == entry.hash && at(slot)->getId() == id) {
+                    slot = entry;
+                    break;
+                }
+            }
+            if (s == end) {
+                overflow[k].push_back(static_cast<std::uint32_t>(i));
+            }
+        }
+    });
+
+    for (auto n : inserted) {
+        count += n;
+    }
+    std::vector<std::uint32_t> rest;
+    for (auto& shard : overflow) {
+        rest.insert(rest.end(), shard.begin(), shard.end());
+    }
+    std::sort(rest.begin(), rest.end());
+    for (auto i : rest) {
+        insert(hashes[i], added[i].type, added[i].index);
+    }
+}
+
+const Citation* CitationTable::find(std::string_view id) const {
+    /*
+    This function is used to look up a citation by ID.
+    It returns null if there is no such citation.
+    */
+    if (slots.empty()) {
+        return nullptr;
+    }
+
+    std::uint64_t hash = hashId(id);
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; slots[i].type != EMPTY; i = (i + 1) & mask) {
+        if (slots[i].hash == hash) {
+            const Citation* citation = at(slots[i]);
+            if (citation->getId() == id) {
+                return citation;
+            }
+        }
+    }
+    return nullptr;
+}
+
+size_t CitationTable::size() const {
+    return count;
+}
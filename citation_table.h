@@ -0,0 +1,95 @@
+#ifndef CITATION_TABLE_H
+#define CITATION_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "citation.h"
+
+class CitationTable {
+/*
+A flat hash table of citations, keyed by citation ID.
+
+Citations are stored by value in one contiguous array per type, the table itself is an
+open-addressing array of small slots (hash, type, position) probed linearly. Lookups take
+a `std::string_view`, so no string has to be built to find a citation. Adding a citation
+with an ID that is already present replaces the earlier one, like assigning into a map.
+
+Pointers returned by `find` stay valid until the table is changed again.
+
+Bulk loads (`beginBulk` ... `endBulk`) only store the citations while they are added and
+build the slot array once at the end, sized for all of them and on several threads: the
+slot array is cut into shards, each shard inserts the IDs whose home slot it holds in
+the order they were added, and the few IDs that probe past the end of their shard are
+inserted afterwards, again in order. Every ID therefore ends up with the citation added
+last, exactly as with one `add` after another.
+
+The table owns a monotonic arena that the strings of its citations should be allocated
+from (pass `resource()` to the citation constructors). The arena is released in one go
+when the table is cleared, assigned to or destroyed. Moving a table moves its arena along
+with the citations.
+*/
+
+private:
+    enum Type : std::uint32_t { EMPTY, BOOK, WEBPAGE, ARTICLE };
+
+    struct Slot {
+        std::uint64_t hash;
+        Type type;
+        std::uint32_t index;
+    };
+
+    struct Pending {
+        Type type;
+        std::uint32_t index;
+    };
+
+    // declared first, so that the citations using the arena are destroyed before it
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+
+    std::vector<Book> books;
+    std::vector<WebPage> webPages;
+    std::vector<Article> articles;
+    std::vector<Slot> slots;
+    size_t count = 0;
+    bool bulk = false;
+    std::vector<Pending> pending;
+
+    const Citation* at(const Slot& slot) const;
+    void insert(std::uint64_t hash, Type type, std::uint32_t index);
+    void grow();
+    void resize(size_t size);
+    void stored(Type type, size_t index);
+public:
+    CitationTable();
+    CitationTable(CitationTable&&) = default;
+    CitationTable& operator=(CitationTable&& other) noexcept;
+
+    std::pmr::memory_resource* resource() const;
+
+    void add(Book citation);
+    void add(WebPage citation);
+    void add(Article citation);
+    void clear();
+
+    void beginBulk();
+    void endBulk(size_t threads);
+
+    const Citation* find(std::string_view id) const;
+    size_t size() const;
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        // call `fn` with every citation in the table, in no particular order
+        for (auto& slot : slots) {
+            if (slot.type != EMPTY) {
+                fn(*at(slot));
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,274 @@
+#include "./index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include "./output.h"
+#include "./utils.hpp"
+
+namespace fs = std::filesystem;
+
+static const char INDEX_MAGIC[8] = {'D', 'O', 'C', 'M', 'I', 'D', 'X', '\0'};
+static const std::uint32_t INDEX_VERSION = 1;
+
+static std::uint64_t hashBytes(std::string_view bytes) {
+    // FNV-1a, taking 8 bytes per step
+    std::uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < bytes.size(); i++) {
+        hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::uint64_t align8(std::uint64_t offset) {
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+bool describeIndexSource(const std::string& sourcePath, IndexSource& source) {
+    /*
+    This function is used to describe the citations file an index is compiled from:
+    its size, modification time and a hash of its contents.
+    It returns false if the file cannot be read.
+    */
+    MappedFile file;
+    std::error_code ec;
+    auto mtime = fs::last_write_time(sourcePath, ec);
+    if (ec || !file.open(sourcePath)) {
+        return false;
+    }
+    source.size = file.view().size();
+    source.mtime = static_cast<std::int64_t>(mtime.time_since_epoch().count());
+    source.hash = hashBytes(file.view());
+    return true;
+}
+
+// IndexBuilder class
+
+IndexString IndexBuilder::addString(std::string_view text) {
+    IndexString result{strings.size(), text.size()};
+    strings.append(text);
+    return result;
+}
+
+void IndexBuilder::addBook(std::string_view id, std::string_view isbn) {
+    entries.push_back({addString(id), INDEX_BOOK, static_cast<std::uint32_t>(books.size())});
+    books.push_back({addString(isbn)});
+}
+
+void IndexBuilder::addWebPage(std::string_view id, std::string_view url) {
+    entries.push_back({addString(id), INDEX_WEBPAGE, static_cast<std::uint32_t>(webPages.size())});
+    webPages.push_back({addString(url)});
+}
+
+void IndexBuilder::addArticle(
+    std::string_view id,
+    std::string_view title,
+    std::string_view author,
+    std::string_view journal,
+    int year,
+    int volume,
+    int issue,
+    bool renderable
+) {
+    entries.push_back({addString(id), INDEX_ARTICLE, static_cast<std::uint32_t>(articles.size())});
+    articles.push_back({
+        addString(title), addString(author), addString(journal),
+        year, volume, issue, renderable ? 1u : 0u
+    });
+}
+
+void IndexBuilder::write(const std::string& path, const IndexSource& source) {
+    /*
+    This function is used to write the collected citations to `path`.
+    The entries are sorted by ID first, so that lookups can use binary search.
+    */
+    auto idOf = [this](const IndexEntry& entry) {
+        return std::string_view(strings).substr(entry.id.offset, entry.id.size);
+    };
+    std::sort(entries.begin(), entries.end(), [&](const IndexEntry& a, const IndexEntry& b) {
+        return idOf(a) < idOf(b);
+    });
+
+    IndexHeader header{};
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.source = source;
+    header.entryCount = entries.size();
+    header.bookCount = books.size();
+    header.webPageCount = webPages.size();
+    header.articleCount = articles.size();
+    header.entriesOffset = align8(sizeof(IndexHeader));
+    header.booksOffset = align8(header.entriesOffset + entries.size() * sizeof(IndexEntry));
+    header.webPagesOffset = align8(header.booksOffset + books.size() * sizeof(IndexBook));
+    header.articlesOffset = align8(header.webPagesOffset + webPages.size() * sizeof(IndexWebPage));
+    header.stringsOffset = align8(header.articlesOffset + articles.size() * sizeof(IndexArticle));
+    header.stringsSize = strings.size();
+
+    AtomicOutput output{path, false};
+    auto& buffer = output.buffer();
+    std::uint64_t written = 0;
+    auto section = [&](std::uint64_t offset, const void* data, std::uint64_t size) {
+        static const char padding[8] = {};
+        buffer.write(std::string_view(padding, offset - written));
+        buffer.write(std::string_view(static_cast<const char*>(data), size));
+        written = offset + size;
+    };
+    section(0, &header, sizeof(header));
+    section(header.entriesOffset, entries.data(), entries.size() * sizeof(IndexEntry));
+    section(header.booksOffset, books.data(), books.size() * sizeof(IndexBook));
+    section(header.webPagesOffset, webPages.data(), webPages.size() * sizeof(IndexWebPage));
+    section(header.articlesOffset, articles.data(), articles.size() * sizeof(IndexArticle));
+    section(header.stringsOffset, strings.data(), strings.size());
+    output.commit();
+}
+
+// CitationIndex class
+
+bool CitationIndex::open(const std::string& indexPath, const std::string& sourcePath) {
+    /*
+    This function is used to open an index compiled from `sourcePath`.
+    It returns false if the index is missing, malformed, or was compiled from a different
+    version of the source (by size, modification time or content hash), and if the source
+    cannot be read; the caller then falls back to the JSON file.
+    */
+    if (!file.open(indexPath)) {
+        return false;
+    }
+    auto bytes = file.view();
+    if (bytes.size() < sizeof(IndexHeader)) {
+        return false;
+    }
+
+    header = reinterpret_cast<const IndexHeader*>(bytes.data());
+    auto fits = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t size) {
+        return offset % 8 == 0 && offset <= bytes.size() && count <= (bytes.size() - offset) / size;
+    };
+    if (std::memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header->version != INDEX_VERSION ||
+        header->entryCount != header->bookCount + header->webPageCount + header->articleCount ||
+        !fits(header->entriesOffset, header->entryCount, sizeof(IndexEntry)) ||
+        !fits(header->booksOffset, header->bookCount, sizeof(IndexBook)) ||
+        !fits(header->webPagesOffset, header->webPageCount, sizeof(IndexWebPage)) ||
+        !fits(header->articlesOffset, header->articleCount, sizeof(IndexArticle)) ||
+        !fits(header->stringsOffset, header->stringsSize, 1)) {
+        return false;
+    }
+
+    std::error_code ec;
+    auto mtime = fs::last_write_time(sourcePath, ec);
+    if (ec || header->source.mtime != static_cast<std::int64_t>(mtime.time_since_epoch().count()) ||
+        header->source.size != fs::file_size(sourcePath, ec) || ec) {
+        return false;
+    }
+    IndexSource source;
+    if (!describeIndexSource(sourcePath, source) || source.hash != header->source.hash) {
+        return false;
+    }
+
+    entries = reinterpret_cast<const IndexEntry*>(bytes.data() + header->entriesOffset);
+    books = reinterpret_cast<const IndexBook*>(bytes.data() + header->booksOffset);
+    webPages = reinterpret_cast<const IndexWebPage*>(bytes.data() + header->webPagesOffset);
+    articles = reinterpret_cast<const IndexArticle*>(bytes.data() + header->articlesOffset);
+    strings = bytes.data() + header->stringsOffset;
+    return true;
+}
+
+std::string_view CitationIndex::str(const IndexString& text) const {
+    if (text.offset > header->stringsSize || text.size > header->stringsSize - text.offset) {
+        // the index is corrupt
+        fail("corrupt citation index");
+    }
+    return std::string_view(strings + text.offset, text.size);
+}
+
+const IndexEntry* CitationIndex::find(std::string_view id) const {
+    /*
+    This function is used to look up the entry for a citation ID.
+    It returns null if there is no such citation.
+    */
+    const IndexEntry* end = entries + header->entryCount;
+    const IndexEntry* it = std::lower_bound(entries, end, id, [this](const IndexEntry& entry, std::string_view id) {
+        return str(entry.id) < id;
+    });
+    if (it == end || str(it->id) != id) {
+        return nullptr;
+    }
+    return it;
+}
+
+void CitationIndex::materialize(const IndexEntry& entry, CitationTable& citations) const {
+    /*
+    This function is used to construct the citation stored in an entry and to add it to
+    `citations`.
+    */
+    std::string_view id = str(entry.id);
+    if (entry.type == INDEX_BOOK && entry.record < header->bookCount) {
+        citations.add(Book(id, str(books[entry.record].isbn), citations.resource()));
+    } else if (entry.type == INDEX_WEBPAGE && entry.record < header->webPageCount) {
+        citations.add(WebPage(id, str(webPages[entry.record].url), citations.resource()));
+    } else if (entry.type == INDEX_ARTICLE && entry.record < header->articleCount) {
+        auto& article = articles[entry.record];
+        citations.add(Article(
+            id,
+            str(article.title),
+            str(article.author),
+            str(article.journal),
+            article.year,
+            article.volume,
+            article.issue,
+            article.renderable != 0,
+            citations.resource()
+        ));
+    } else {
+        fail("corrupt citation index");
+    }
+}
+
+// IndexedCitationSource class
+
+IndexedCitationSource::IndexedCitationSource(const CitationIndex& index) : index(index) {}
+
+const CitationTable& IndexedCitationSource::resolve(const std::set<std::string>& ids) {
+    /*
+    This function is used to materialize the referenced citations from the index.
+    */
+    citations.clear();
+    for (auto& id : ids) {
+        if (auto entry = index.find(id)) {
+            index.materialize(*entry, citations);
+        }
+    }
+    return citations;
+}
+
+void compileCitationIndex(const std::string& sourcePath, const std::string& indexPath) {
+    /*
+    Compile a citations file into a binary index.
+
+    The source is loaded and validated exactly like `loadCitations` does for a normal run,
+    so any error in it, including a source that cannot be read, is reported through `fail`
+    here instead of when using the index.
+
+    Args:
+        sourcePath: The path to the JSON citations file.
+        indexPath: The path to write the index to.
+    */
+    IndexSource source;
+    if (!describeIndexSource(sourcePath, source)) {
+        fail("cannot read " + sourcePath);
+    }
+    auto citations = loadCitations(sourcePath);
+
+    IndexBuilder builder;
+    citations.forEach([&](const Citation& citation) {
+        citation.addToIndex(builder);
+    });
+    builder.write(indexPath, source);
+}
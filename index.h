@@ -0,0 +1,158 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "citation.h"
+#include "citation_table.h"
+#include "loader.h"
+#include "mapped_file.h"
+
+/*
+Binary layout of a compiled citation index.
+
+The file starts with an `IndexHeader`, followed by the sections it points to: the entries
+sorted by ID, one array of fixed-size records per citation type, and a string arena that
+all `IndexString`s point into. Every section starts at a multiple of 8 bytes, so the file
+can be used in place once it is mapped.
+*/
+
+struct IndexString {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct IndexEntry {
+    IndexString id;
+    std::uint32_t type;     // one of the `IndexType` values
+    std::uint32_t record;   // position in the records of that type
+};
+
+enum IndexType : std::uint32_t {
+    INDEX_BOOK = 0,
+    INDEX_WEBPAGE = 1,
+    INDEX_ARTICLE = 2
+};
+
+struct IndexBook {
+    IndexString isbn;
+};
+
+struct IndexWebPage {
+    IndexString url;
+};
+
+struct IndexArticle {
+    IndexString title;
+    IndexString author;
+    IndexString journal;
+    std::int32_t year;
+    std::int32_t volume;
+    std::int32_t issue;
+    std::uint32_t renderable;   // 0 if the fields would not pass Article::render
+};
+
+struct IndexSource {
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    std::uint64_t hash = 0;
+};
+
+struct IndexHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    IndexSource source;
+    std::uint64_t entryCount;
+    std::uint64_t bookCount;
+    std::uint64_t webPageCount;
+    std::uint64_t articleCount;
+    std::uint64_t entriesOffset;
+    std::uint64_t booksOffset;
+    std::uint64_t webPagesOffset;
+    std::uint64_t articlesOffset;
+    std::uint64_t stringsOffset;
+    std::uint64_t stringsSize;
+};
+
+class IndexBuilder {
+/*
+This class collects citations and writes them as a compiled citation index.
+Citations add themselves through `Citation::addToIndex`.
+*/
+
+private:
+    std::string strings;
+    std::vector<IndexEntry> entries;
+    std::vector<IndexBook> books;
+    std::vector<IndexWebPage> webPages;
+    std::vector<IndexArticle> articles;
+
+    IndexString addString(std::string_view text);
+public:
+    void addBook(std::string_view id, std::string_view isbn);
+    void addWebPage(std::string_view id, std::string_view url);
+    void addArticle(
+        std::string_view id,
+        std::string_view title,
+        std::string_view author,
+        std::string_view journal,
+        int year,
+        int volume,
+        int issue,
+        bool renderable
+    );
+
+    void write(const std::string& path, const IndexSource& source);
+};
+
+class CitationIndex {
+/*
+This class represents an opened compiled citation index.
+
+Opening maps the file and checks its header, which is O(1) in the number of citations,
+and then maps and hashes the whole citations file to make sure the index was compiled
+from it. That is linear in the size of the citations file, but much cheaper than parsing
+it. `find` is a binary search over the mapped entries and does not allocate;
+`materialize` constructs the citation object for an entry.
+*/
+
+private:
+    MappedFile file;
+    const IndexHeader* header = nullptr;
+    const IndexEntry* entries = nullptr;
+    const IndexBook* books = nullptr;
+    const IndexWebPage* webPages = nullptr;
+    const IndexArticle* articles = nullptr;
+    const char* strings = nullptr;
+
+    std::string_view str(const IndexString& text) const;
+public:
+    bool open(const std::string& indexPath, const std::string& sourcePath);
+
+    const IndexEntry* find(std::string_view id) const;
+    void materialize(const IndexEntry& entry, CitationTable& citations) const;
+};
+
+class IndexedCitationSource : public CitationSource {
+/*
+This class represents a citations file that was compiled into an index. Only the
+referenced entries are materialized; the rest were validated when the index was compiled.
+*/
+
+private:
+    const CitationIndex& index;
+    CitationTable citations;
+public:
+    explicit IndexedCitationSource(const CitationIndex& index);
+
+    const CitationTable& resolve(const std::set<std::string>& ids) override;
+};
+
+bool describeIndexSource(const std::string& sourcePath, IndexSource& source);
+void compileCitationIndex(const std::string& sourcePath, const std::string& indexPath);
+
+#endif
@@ -0,0 +1,291 @@
+#include "./loader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <initializer_list>
+#include <thread>
+
+#include "./mapped_file.h"
+#include "./utils.hpp"
+
+class CitationSaxHandler {
+/*
+SAX handler that builds citations while the citations file is being parsed.
+
+No DOM of the whole file is ever built. For each item of the top-level "citations" array
+only the fields some citation type needs are collected into a small JSON object, which is
+trimmed to the fields of the item's type and handed to the matching constructor as soon
+as the item ends. Everything else in the file is skipped.
+
+Errors are recorded rather than reported immediately, `loadCitations` checks them once
+parsing has finished. With a set of `only` IDs, items with other (or no) IDs are skipped
+without being validated.
+*/
+
+public:
+    using json = nlohmann::json;
+
+private:
+    enum class State { Missing, Array, Invalid };
+
+    CitationTable& citations;
+    const std::set<std::string>* only;
+    size_t depth = 0;
+    bool rootIsObject = false;
+    std::string rootKey;
+    State citationsState = State::Missing;
+    size_t itemCount = 0;
+    bool invalidItem = false;
+    bool inItem = false;
+    std::string itemKey;
+    json item;
+
+    static bool isNeeded(const std::string& key);
+    bool inCitations() const;
+    void value(json&& value);
+    void container(json&& placeholder);
+    void finishItem();
+public:
+    CitationSaxHandler(CitationTable& citations, const std::set<std::string>* only)
+        : citations(citations), only(only) {}
+
+    bool valid() const;
+
+    bool null() { value(nullptr); return true; }
+    bool boolean(bool val) { value(val); return true; }
+    bool number_integer(json::number_integer_t val) { value(val); return true; }
+    bool number_unsigned(json::number_unsigned_t val) { value(val); return true; }
+    bool number_float(json::number_float_t val, const json::string_t&) { value(val); return true; }
+    bool string(json::string_t& val) { value(std::move(val)); return true; }
+    bool binary(json::binary_t& val) { value(json::binary(std::move(val))); return true; }
+
+    bool start_object(size_t);
+    bool end_object();
+    bool start_array(size_t);
+    bool end_array();
+    bool key(json::string_t& val);
+
+    bool parse_error(size_t, const std::string&, const nlohmann::detail::exception&) {
+        return false;
+    }
+};
+
+bool CitationSaxHandler::isNeeded(const std::string& key) {
+    for (auto name : {"type", "id", "isbn", "url", "title", "author", "journal", "year", "volume", "issue"}) {
+        if (key == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CitationSaxHandler::inCitations() const {
+    return citationsState == State::Array && rootKey == "citations";
+}
+
+bool CitationSaxHandler::valid() const {
+    return rootIsObject && citationsState == State::Array && itemCount > 0 && !invalidItem;
+}
+
+void CitationSaxHandler::value(json&& val) {
+    /*
+    This function is used to handle a scalar value at the current position.
+    Depth 0 is the root, 1 the members of the root object, 2 the citation items and 3 the
+    fields of an item.
+    */
+    if (depth == 1 && rootKey == "citations") {
+        citationsState = State::Invalid;
+    } else if (depth == 2 && inCitations()) {
+        // every item must be an object
+        ++itemCount;
+        invalidItem = only == nullptr;
+    } else if (depth == 3 && inItem && isNeeded(itemKey)) {
+        item[itemKey] = std::move(val);
+    }
+}
+
+void CitationSaxHandler::container(json&& placeholder) {
+    /*
+    This function is used to handle the start of an object or array that is not part of
+    the structure itself. A needed field holding a container keeps an empty placeholder,
+    so that the constructors see the field but reject its type like they would for the
+    full value.
+    */
+    if (depth == 1 && rootKey == "citations") {
+        citationsState = State::Invalid;
+    } else if (depth == 2 && inCitations()) {
+        ++itemCount;
+        invalidItem = only == nullptr;
+    } else if (depth == 3 && inItem && isNeeded(itemKey)) {
+        item[itemKey] = std::move(placeholder);
+    }
+}
+
+bool CitationSaxHandler::start_object(size_t) {
+    if (depth == 0) {
+        rootIsObject = true;
+    } else if (depth == 2 && inCitations()) {
+        ++itemCount;
+        inItem = true;
+        item = json::object();
+    } else {
+        container(json::object());
+    }
+    ++depth;
+    return true;
+}
+
+bool CitationSaxHandler::end_object() {
+    --depth;
+    if (depth == 2 && inItem) {
+        inItem = false;
+        finishItem();
+    }
+    return true;
+}
+
+bool CitationSaxHandler::start_array(size_t) {
+    if (depth == 1 && rootKey == "citations") {
+        citationsState = State::Array;
+    } else {
+        container(json::array());
+    }
+    ++depth;
+    return true;
+}
+
+bool CitationSaxHandler::end_array() {
+    --depth;
+    if (depth == 1) {
+        rootKey.clear();
+    }
+    return true;
+}
+
+bool CitationSaxHandler::key(json::string_t& val) {
+    if (depth == 1) {
+        rootKey = val;
+        if (rootKey == "citations") {
+            // a repeated key replaces the earlier value, like in a parsed DOM
+            citations.clear();
+            citationsState = State::Missing;
+            itemCount = 0;
+            invalidItem = false;
+        }
+    } else if (depth == 3 && inItem) {
+        itemKey = val;
+    }
+    return true;
+}
+
+void CitationSaxHandler::finishItem() {
+    /*
+    This function is used to construct the citation of a finished item.
+    Each item should have a string "type" and "id" field, and the type must be known.
+    */
+    if (only != nullptr) {
+        auto id = item.find("id");
+        if (id == item.end() || !id->is_string() || only->count(id->get_ref<const std::string&>()) == 0) {
+            return;
+        }
+    }
+
+    if (!item.contains("type") ||
+        !item.contains("id")   ||
+        !item["type"].is_string() ||
+        !item["id"].is_string()) {
+        fail("citation without a type or an id");
+    }
+    std::string type = item["type"].get<std::string>();
+    std::string id = item["id"].get<std::string>();
+
+    auto keep = [this](std::initializer_list<const char*> fields) {
+        json trimmed = json::object();
+        for (auto field : fields) {
+            if (item.contains(field)) {
+                trimmed[field] = std::move(item[field]);
+            }
+        }
+        item = std::move(trimmed);
+    };
+
+    if (type == "book") {
+        keep({"id", "isbn"});
+        citations.add(Book(item, citations.resource()));
+    } else if (type == "webpage") {
+        keep({"id", "url"});
+        citations.add(WebPage(item, citations.resource()));
+    } else if (type == "article") {
+        keep({"id", "title", "author", "journal", "year", "volume", "issue"});
+        citations.add(Article(item, citations.resource()));
+    } else {
+        fail("unknown citation type");
+    }
+}
+
+CitationTable loadCitations(
+    const std::string& filename,
+    const std::set<std::string>* only,
+    size_t threads
+) {
+    /*
+    Load citations from a JSON file.
+    
+    This function reads a JSON file specified by `filename` and constructs a table of
+    citations while parsing it (see `CitationSaxHandler`), keyed by citation ID. The hash
+    table over them is built once after parsing, on `threads` threads (by default one per
+    core); if an ID occurs more than once, the last entry with it wins.
+    
+    Each citation object in the "citations" **array** should have a "type" and an "id" field.
+    Each error in the JSON file should be handled by calling `fail`.
+
+    Args:
+        filename: A string representing the path to the JSON file.
+        only: If not null, only the citations with these IDs are constructed and validated.
+        threads: The number of threads building the hash table, 0 for one per core.
+    
+    Returns:
+        A table of the loaded citations.
+    */
+
+    CitationTable citations;
+    CitationSaxHandler handler{citations, only};
+    citations.beginBulk();
+
+    bool parsed;
+    MappedFile mapped;
+    if (mapped.open(filename)) {
+        parsed = nlohmann::json::sax_parse(mapped.view(), &handler);
+    } else {
+        std::ifstream file{filename};
+        parsed = nlohmann::json::sax_parse(file, &handler);
+    }
+
+    if (!parsed || !handler.valid()) {
+        fail("invalid citations file");
+    }
+
+    citations.endBulk(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency()));
+    return citations;
+}
+
+// EagerCitationSource class
+
+EagerCitationSource::EagerCitationSource(CitationTable citations)
+    : citations(std::move(citations)) {}
+
+const CitationTable& EagerCitationSource::resolve(const std::set<std::string>&) {
+    return citations;
+}
+
+// LazyCitationSource class
+
+LazyCitationSource::LazyCitationSource(const std::string& filename) : filename(filename) {}
+
+const CitationTable& LazyCitationSource::resolve(const std::set<std::string>& ids) {
+    /*
+    This function is used to load the referenced citations on first use.
+    */
+    citations = loadCitations(filename, &ids);
+    return citations;
+}
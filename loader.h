@@ -0,0 +1,59 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <set>
+#include <string>
+
+#include "citation.h"
+#include "citation_table.h"
+
+CitationTable loadCitations(
+    const std::string& filename,
+    const std::set<std::string>* only = nullptr,
+    size_t threads = 0
+);
+
+class CitationSource {
+/*
+Base class for the places `outputCitations` gets citations from.
+
+`resolve` is called once, after the whole input has been scanned, with every referenced
+ID. It returns the citations for those IDs; IDs without a citation are simply missing.
+*/
+
+public:
+    virtual ~CitationSource() = default;
+
+    virtual const CitationTable& resolve(const std::set<std::string>& ids) = 0;
+};
+
+class EagerCitationSource : public CitationSource {
+/*
+This class represents a citations file that was fully loaded and validated up front.
+*/
+
+private:
+    CitationTable citations;
+public:
+    explicit EagerCitationSource(CitationTable citations);
+
+    const CitationTable& resolve(const std::set<std::string>& ids) override;
+};
+
+class LazyCitationSource : public CitationSource {
+/*
+This class represents a citations file that is only loaded once the referenced IDs are
+known. Only the referenced entries are constructed and validated, the rest of the file
+just has to be well-formed JSON.
+*/
+
+private:
+    std::string filename;
+    CitationTable citations;
+public:
+    explicit LazyCitationSource(const std::string& filename);
+
+    const CitationTable& resolve(const std::set<std::string>& ids) override;
+};
+
+#endif
@@ -1,128 +1,360 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
-#include <tuple>
-#include <unordered_map>
+#include <stdexcept>
+#include <thread>
+#include <string_view>
 #include <vector>
 
 #include "citation.h"
+#include "cpp-httplib/httplib.h"
+#include "index.h"
+#include "loader.h"
+#include "mapped_file.h"
+#include "output.h"
+#include "scanner.h"
 #include "utils.hpp"
-
-// use CitationPtr to represent a shared pointer to Citation
-
-std::unordered_map<std::string, CitationPtr> loadCitations(const std::string& filename) {
-    // FIXME: load citations from file
-
+#include "web.h"
+
+struct ServeOptions {
+    bool enabled = false;
+    std::string host = "127.0.0.1";
+    int port = 8765;
+    std::string socketPath;                     // listen on a Unix domain socket instead
+    long long reloadIntervalMs = 1000;
+};
+
+struct Options {
+    std::string citationFile;
+    std::vector<std::string> inputFiles;
+    std::string batchFile;
+    std::string outputFile;
+    size_t jobs = 8;
+    WebOptions web;
+    bool stats = false;
+    bool lazy = false;
+    std::string indexFile;
+    ServeOptions serve;
+};
+
+Options parseArgs(int argc, char** argv) {
     /*
-    Load citations from a JSON file.
-    
-    This function reads a JSON file specified by `filename`, parses it into a JSON object,
-    and then constructs a map of `CitationPtr` objects. The keys in the map are the citation
-    IDs, and the values are the corresponding `CitationPtr` objects.
+    Parse command line arguments.
+
+    This function parses the command line arguments passed to the program and extracts the
+    citation file name, input file name, output file name and the number of concurrent
+    web lookups. The program expects arguments of the form:
     
-    Each citation object in the "citations" **array** should have a "type" and an "id" field.
-    Each error in the JSON file should be handled by calling `std::exit(1)`.
+    - "docman", "-c", "citations.json", ["-o", "output.txt"], ["-j", "8"], "input.txt"/"-"
+
+    Several input files, or "--batch inputs.txt" naming one input file per line, process
+    all of them in one run (see `outputBatch`). "-o" then names the directory the outputs
+    are written to; by default each output is written next to its input with ".out" added.
+
+    In addition, "--endpoint URL" overrides the metadata API endpoint (e.g. to point at a
+    local mock server), and "--stats" prints web lookup statistics to stderr ("docman
+    serve" answers GET /stats with them instead).
+    "--cache-dir DIR" keeps web responses on disk between runs, "--cache-ttl SECONDS" and
+    "--cache-max-size BYTES" bound how long entries are used and how large the cache grows.
+    "--lazy" loads the citations file only after the input has been scanned, and only
+    constructs and validates the entries the input references. "--index FILE" uses an
+    index compiled from the citations file (see `compileDb`) if it is still up to date.
+    "--batch-endpoint PATH" fetches the referenced books and webpages in batch requests to
+    PATH on the API endpoint, "--batch-size N" of them per request (see `prefetchFromWeb`).
+    "--connect-timeout MS" and "--read-timeout MS" bound each request, failed requests are
+    retried "--retries N" times with a jittered backoff starting at "--retry-backoff MS",
+    and "--deadline MS" bounds each lookup as a whole. "--hedge" sends a second request
+    for a lookup that takes longer than the recent p95 latency.
+
+    For "docman serve" (see `serve`), no input file is given; "--host HOST" and "--port N"
+    or "--socket PATH" choose where to listen, "--reload-interval MS" how often the
+    citations file is checked for changes. "--lazy", "--index", "--batch" and "-o" do not
+    apply there.
+
+    "-c" and at least one input file are required, each option may be given at most once.
+    If the arguments do not match this pattern, the function will call `std::exit(1)`.
 
     Args:
-        filename: A string representing the path to the JSON file.
+        argc: An integer representing the number of command line arguments.
+        argv: A pointer to an array of C-style strings representing the command line arguments.
     
     Returns:
-        A map of citation IDs to `CitationPtr` objects.
+        An `Options` struct holding the parsed arguments.
     */
 
-    std::ifstream file{filename};
-    nlohmann::json citationJson;
-
-    citationJson = nlohmann::json::parse(file);
+    Options options;
+    options.serve.enabled = argc > 1 && std::string(argv[1]) == "serve";
+    bool serving = options.serve.enabled;
+    bool hasPort = false;
+    bool hasHost = false;
+    bool hasReloadInterval = false;
+    bool hasJobs = false;
+    bool hasEndpoint = false;
+    bool hasCacheTtl = false;
+    bool hasCacheMaxSize = false;
+    bool hasBatchSize = false;
+    bool hasConnectTimeout = false;
+    bool hasReadTimeout = false;
+    bool hasRetries = false;
+    bool hasBackoff = false;
+    bool hasDeadline = false;
+    auto parseNumber = [](const std::string& value) {
+        if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string::npos) {
+            std::exit(1);
+        }
+        return std::stoll(value);
+    };
+    for (int i = serving ? 2 : 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-c" && hasValue && options.citationFile.empty()) {
+            options.citationFile = argv[++i];
+        } else if (!serving && arg == "-o" && hasValue && options.outputFile.empty()) {
+            options.outputFile = argv[++i];
+        } else if (arg == "-j" && hasValue && !hasJobs) {
+            options.jobs = parseNumber(argv[++i]);
+            if (options.jobs == 0) {
+                std::exit(1);
+            }
+            hasJobs = true;
+        } else if (arg == "--endpoint" && hasValue && !hasEndpoint) {
+            options.web.endpoint = argv[++i];
+            hasEndpoint = true;
+        } else if (arg == "--cache-dir" && hasValue && options.web.cacheDir.empty()) {
+            options.web.cacheDir = argv[++i];
+        } else if (arg == "--cache-ttl" && hasValue && !hasCacheTtl) {
+            options.web.cacheTtl = parseNumber(argv[++i]);
+            hasCacheTtl = true;
+        } else if (arg == "--cache-max-size" && hasValue && !hasCacheMaxSize) {
+            options.web.cacheMaxBytes = parseNumber(argv[++i]);
+            hasCacheMaxSize = true;
+        } else if (arg == "--batch-endpoint" && hasValue && options.web.batchPath.empty()) {
+            options.web.batchPath = argv[++i];
+            if (options.web.batchPath.empty() || options.web.batchPath[0] != '/') {
+                std::exit(1);
+            }
+        } else if (arg == "--batch-size" && hasValue && !hasBatchSize) {
+            options.web.batchSize = parseNumber(argv[++i]);
+            if (options.web.batchSize == 0) {
+                std::exit(1);
+            }
+            hasBatchSize = true;
+        } else if (arg == "--connect-timeout" && hasValue && !hasConnectTimeout) {
+            options.web.connectTimeoutMs = parseNumber(argv[++i]);
+            hasConnectTimeout = true;
+        } else if (arg == "--read-timeout" && hasValue && !hasReadTimeout) {
+            options.web.readTimeoutMs = parseNumber(argv[++i]);
+            hasReadTimeout = true;
+        } else if (arg == "--retries" && hasValue && !hasRetries) {
+            options.web.retries = parseNumber(argv[++i]);
+            hasRetries = true;
+        } else if (arg == "--retry-backoff" && hasValue && !hasBackoff) {
+            options.web.backoffMs = parseNumber(argv[++i]);
+            hasBackoff = true;
+        } else if (arg == "--deadline" && hasValue && !hasDeadline) {
+            options.web.deadlineMs = parseNumber(argv[++i]);
+            hasDeadline = true;
+        } else if (arg == "--hedge" && !options.web.hedge) {
+            options.web.hedge = true;
+        } else if (arg == "--stats" && !options.stats) {
+            options.stats = true;
+        } else if (serving && arg == "--host" && hasValue && !hasHost) {
+            options.serve.host = argv[++i];
+            hasHost = true;
+        } else if (serving && arg == "--port" && hasValue && !hasPort) {
+            options.serve.port = parseNumber(argv[++i]);
+            if (options.serve.port == 0 || options.serve.port > 65535) {
+                std::exit(1);
+            }
+            hasPort = true;
+        } else if (serving && arg == "--socket" && hasValue && options.serve.socketPath.empty()) {
+            options.serve.socketPath = argv[++i];
+        } else if (serving && arg == "--reload-interval" && hasValue && !hasReloadInterval) {
+            options.serve.reloadIntervalMs = parseNumber(argv[++i]);
+            hasReloadInterval = true;
+        } else if (!serving && arg == "--lazy" && !options.lazy) {
+            options.lazy = true;
+        } else if (!serving && arg == "--index" && hasValue && options.indexFile.empty()) {
+            options.indexFile = argv[++i];
+        } else if (!serving && arg == "--batch" && hasValue && options.batchFile.empty()) {
+            options.batchFile = argv[++i];
+        } else if (!serving && (arg == "-" || (!arg.empty() && arg[0] != '-'))) {
+            options.inputFiles.push_back(arg);
+        } else {
+            std::exit(1);
+        }
+    }
 
-    if (!citationJson.contains("citations") || citationJson.empty()) {
+    if (options.citationFile.empty()) {
         std::exit(1);
     }
-    nlohmann::json data = citationJson["citations"];
-    std::unordered_map<std::string, CitationPtr> citations;
-
-    if (data.empty() || !data.is_array()) {
+    if (serving) {
+        return options;
+    }
+    if (options.inputFiles.empty() && options.batchFile.empty()) {
         std::exit(1);
     }
-
-    for (auto& item : data) {
-        if (
-            !item.contains("type")    || 
-            !item.contains("id")      || 
-            !item["type"].is_string() || 
-            !item["id"].is_string()) {
+    if (!options.batchFile.empty()) {
+        std::ifstream batch{options.batchFile};
+        if (!batch.good()) {
             std::exit(1);
         }
-        std::string type = item["type"].get<std::string>();
-        std::string id = item["id"].get<std::string>();
-        if (type == "book") {
-            citations[id] = std::make_shared<Book>(item);
-        } else if (type == "webpage") {
-            citations[id] = std::make_shared<WebPage>(item);
-        } else if (type == "article") {
-            citations[id] = std::make_shared<Article>(item);
-        } else {
+        std::string line;
+        while (std::getline(batch, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                options.inputFiles.push_back(line);
+            }
+        }
+        if (options.inputFiles.empty()) {
             std::exit(1);
         }
     }
 
-    return citations;
+    return options;
 }
 
-std::tuple<std::string, std::string, std::string> parseArgs(int argc, char** argv) {
+void checkScanned(const CitationScanner& scanner) {
     /*
-    Parse command line arguments.
-
-    This function parses the command line arguments passed to the program and extracts the
-    citation file name, input file name, and output file name. The program expects one of
-    the following sets of arguments:
-    
-    - "docman", "-c", "citations.json", "input.txt"/"-"
-    - "docman", "-c", "citations.json", "-o", "output.txt", "input.txt"/"-"
+    Check an input text the scanner has seen completely: its brackets must be balanced
+    and it must cite something. Any error is handled by calling `fail`.
+    */
 
-    If the arguments do not match one of these patterns, the function will call `std::exit(1)`.
+    // if the brackets are not balanced, the number of left brackets is not equal to the number of right brackets
+    if (!scanner.balanced()) {
+        fail("unbalanced brackets");
+    }
+    if (scanner.citationIDs().empty()) {
+        fail("no citations");
+    }
+}
 
-    Args:
-        argc: An integer representing the number of command line arguments.
-        argv: A pointer to an array of C-style strings representing the command line arguments.
-    
-    Returns:
-        A tuple containing the citation file name, input file name, and output file name.
+std::vector<const Citation*> findReferences(const std::set<std::string>& ids, const CitationTable& citations) {
+    /*
+    Look up the cited IDs, in sorted order. A missing ID is handled by calling `fail`.
     */
+    std::vector<const Citation*> referenced;
+    for (auto& id : ids) {
+        auto citation = citations.find(id);
+        if (citation == nullptr) {
+            fail("unknown citation " + id);
+        }
+        referenced.push_back(citation);
+    }
+    return referenced;
+}
+
+void renderAll(const std::vector<const Citation*>& referenced, size_t jobs) {
+    /*
+    Render the given citations, fetching what they need from the web first.
 
+    The web lookups of all citations are started together and awaited before anything is
+    rendered; the lookup threads (see `getFromWebAsync`) run up to `jobs` of them at a
+    time, so they overlap instead of running one after another. Any error is handled by
+    calling `fail`.
+    */
 
-    std::string citationFile, inputFile, outputFile;
-    if (argc == 4) {
-        // "docman", "-c", "citations.json", "input.txt"
-        if (std::string(argv[1]) != "-c") {
-            std::exit(1);
+    // fetch what can be fetched in batches first, then start the remaining lookups all
+    // at once and wait for them together; rendering then needs no more round trips
+    std::vector<std::string> resources;
+    for (auto& citation : referenced) {
+        auto resource = citation->getResourcePath();
+        if (!resource.empty()) {
+            resources.push_back(std::move(resource));
         }
-        citationFile = argv[2];
-        inputFile = argv[3];
-
-    } else if (argc == 6) {
-        // "docman", "-c", "citations.json", "-o", "output.txt", "input.txt"
-        if (std::string(argv[1]) != "-c" || std::string(argv[3]) != "-o") {
-            std::exit(1);
+    }
+    try {
+        prefetchFromWeb(resources);
+        std::vector<std::shared_future<std::string>> lookups;
+        for (auto& citation : referenced) {
+            if (!citation->getResourcePath().empty()) {
+                lookups.push_back(citation->getResourceAsync());
+            }
+        }
+        for (auto& lookup : lookups) {
+            lookup.get();
         }
-        citationFile = argv[2];
-        outputFile = argv[4];
-        inputFile = argv[5];
 
-    } else {
+        // each citation keeps its rendered form
+        parallelFor(referenced.size(), jobs, [&](size_t i) {
+            referenced[i]->toString();
+        });
+    } catch(const std::exception& e) {
+        fail(e.what());
+    } catch(...) {
+        fail();
+    }
+}
 
-        std::exit(1);
+std::vector<const Citation*> renderReferences(
+    const CitationScanner& scanner,
+    CitationSource& source,
+    size_t jobs
+) {
+    /*
+    Check the scanned input text and render the citations it references.
+
+    Nothing is written here, so callers can finish all validation before any output
+    becomes visible. Any errors should be handled by calling `fail`.
+
+    Args:
+        scanner: The scanner that has seen the whole input text.
+        source: Where to get the referenced citations from.
+        jobs: The maximum number of citations fetched and rendered concurrently.
 
+    Returns:
+        The referenced citations in sorted ID order, each already rendered.
+    */
+    checkScanned(scanner);
+
+    const CitationTable* citations;
+    try {
+        citations = &source.resolve(scanner.citationIDs());
+    } catch(const std::exception& e) {
+        fail(e.what());
+    } catch(...) {
+        fail();
     }
 
-    return std::make_tuple(citationFile, inputFile, outputFile);
+    auto referenced = findReferences(scanner.citationIDs(), *citations);
+    renderAll(referenced, jobs);
+    return referenced;
+}
+
+void outputReferences(OutputBuffer& output, const std::vector<const Citation*>& referenced) {
+    output.write("\nReferences:\n");
+    for (auto& citation : referenced) {
+        output.write(citation->toString()).put('\n');
+    }
+}
+
+void outputDocument(std::string_view input, OutputBuffer& output, const std::vector<const Citation*>& referenced) {
+    /*
+    Write a whole input text followed by its references. Like `std::getline`, a missing
+    newline at the end of the last line is added.
+    */
+    output.write(input);
+    if (!input.empty() && input.back() != '\n') {
+        output.put('\n');
+    }
+    outputReferences(output, referenced);
 }
 
 void outputCitations(
     std::istream& input, 
-    std::stringstream& outputBuf, 
-    const std::unordered_map<std::string, CitationPtr>& citations
+    OutputBuffer& output, 
+    CitationSource& source,
+    size_t jobs
 ) {
     /*
     Process citations in the input text and output them.
@@ -130,109 +362,412 @@ void outputCitations(
     This function reads lines from the `input` stream expected to contain citations in the 
     format "[citationID]", checks if the brackets in each line are balanced, and extracts 
     citation IDs from the lines. It then outputs the lines and the corresponding citations
-    to the `outputBuf` stream.
+    to the `output` stream.
+
+    Lines are passed through as soon as they are read, so `output` must not be visible to
+    anyone until the whole call has succeeded (see `AtomicOutput`).
 
     Any errors in the input text should be handled by calling `std::exit(1)`.
 
     Args:
         input: A reference to an input stream.
-        outputBuf: A reference to a stringstream to store the output.
-        citations: A map of citation IDs to `CitationPtr` objects.
+        output: A reference to the buffer to write the output to.
+        source: Where to get the referenced citations from.
+        jobs: The maximum number of citations fetched and rendered concurrently.
     */
 
-    std::set<std::string> citationIDs;
+    CitationScanner scanner;
     std::string line;
-    std::regex citationRegex{"\\[(.*?)\\]"};
-    int bracketCount = 0;
 
     while(std::getline(input, line)) {
-        outputBuf << line << std::endl;
-
-        // check if brackets are balanced
-        for (char c : line) {
-            if (c == '[') {
-                ++bracketCount;
-            } else if (c == ']') {
-                --bracketCount;
-            }
-
-            if (bracketCount < 0) {
-                std::exit(1);
-            }
-        }
+        output.write(line).put('\n');
 
-        std::smatch matches;
-        std::string::const_iterator searchStart(line.cbegin());
-        while (std::regex_search(searchStart, line.cend(), matches, citationRegex)) {
-            citationIDs.insert(matches[1].str());
-            searchStart = matches.suffix().first;
+        // check if brackets are balanced and collect the citation IDs in one pass
+        scanner.scan(line);
+        if (scanner.failed()) {
+            std::exit(1);
         }
     }
 
-    // if bracketCount is not 0, it means the number of left brackets is not equal to the number of right brackets
-    if (bracketCount != 0) {
+    outputReferences(output, renderReferences(scanner, source, jobs));
+}
+
+void outputCitations(
+    std::string_view input,
+    OutputBuffer& output,
+    CitationSource& source,
+    size_t jobs
+) {
+    /*
+    Process citations in an input text that is already in memory (e.g. a mapped file).
+
+    This does the same as the stream version, but scans the whole text in place and
+    writes it out in one piece instead of copying it line by line. Large texts are scanned
+    on all cores. Like `std::getline`, a missing newline at the end of the last line is
+    added. All validation happens before the first byte is written, so `output` may be
+    visible directly.
+
+    Args:
+        input: The whole input text.
+        output: A reference to the buffer to write the output to.
+        source: Where to get the referenced citations from.
+        jobs: The maximum number of citations fetched and rendered concurrently.
+    */
+
+    CitationScanner scanner;
+    scanner.scan(input, std::max(1u, std::thread::hardware_concurrency()));
+    if (scanner.failed()) {
         std::exit(1);
     }
+    outputDocument(input, output, renderReferences(scanner, source, jobs));
+}
+
+struct BatchInput {
+    std::string inputFile;
+    std::string outputFile;
+    MappedFile text;
+    CitationScanner scanner;
+    std::vector<const Citation*> referenced;
+};
+
+void outputBatch(std::vector<BatchInput>& inputs, CitationSource& source, size_t jobs) {
+    /*
+    Process many input files in one run, each into its own output file.
 
-    if (citationIDs.empty()) {
+    All inputs are scanned first, up to `jobs` at a time, and the citations file is
+    resolved once for every ID any of them cites. The web lookups of all inputs are then
+    started together, so a book cited in several inputs is fetched once, and finally the
+    outputs are written up to `jobs` at a time. Each output appears complete or not at
+    all, like in the single-input case.
+
+    Any error in any input is handled by calling `std::exit(1)` on the calling thread, once
+    the workers writing other outputs have finished; inputs whose outputs were already
+    written keep them.
+
+    Args:
+        inputs: The input files and the paths of their outputs.
+        source: Where to get the referenced citations from.
+        jobs: The maximum number of inputs, and of citations, processed concurrently.
+    */
+    try {
+        parallelFor(inputs.size(), jobs, [&](size_t i) {
+            auto& input = inputs[i];
+            if (!input.text.open(input.inputFile)) {
+                throw std::runtime_error("cannot read " + input.inputFile);
+            }
+            input.scanner.scan(input.text.view());
+        });
+    } catch(...) {
         std::exit(1);
     }
-    outputBuf << "\nReferences:\n";
-    for (auto& id : citationIDs) {
-        try{
-            outputBuf << citations.at(id)->toString() << std::endl;
-        } catch(...) {
+
+    std::set<std::string> ids;
+    for (auto& input : inputs) {
+        if (input.scanner.failed()) {
             std::exit(1);
         }
+        checkScanned(input.scanner);
+        ids.insert(input.scanner.citationIDs().begin(), input.scanner.citationIDs().end());
+    }
+
+    const CitationTable* citations;
+    try {
+        citations = &source.resolve(ids);
+    } catch(...) {
+        std::exit(1);
+    }
+    for (auto& input : inputs) {
+        input.referenced = findReferences(input.scanner.citationIDs(), *citations);
+    }
+    renderAll(findReferences(ids, *citations), jobs);
+
+    try {
+        parallelFor(inputs.size(), jobs, [&](size_t i) {
+            auto& input = inputs[i];
+            AtomicOutput output{input.outputFile, false};
+            outputDocument(input.text.view(), output.buffer(), input.referenced);
+            output.commit();
+        });
+    } catch(...) {
+        std::exit(1);
     }
 }
 
-int main(int argc, char** argv) {
-    
-    std::stringstream outputBuf;
+std::string formatWebStats() {
+    /*
+    Describe the web lookup statistics in one line, without a trailing newline.
+    */
+    auto webStats = getWebStats();
+    std::ostringstream line;
+    line << "web: " << webStats.cacheHits << " cache hits, "
+         << webStats.requests << " requests, "
+         << webStats.connectionsOpened << " connections opened, "
+         << webStats.connectionsReused << " connections reused, "
+         << webStats.batchRequests << " batch requests for "
+         << webStats.batchedResources << " resources, "
+         << webStats.coalescedRequests << " fetches saved by coalescing, "
+         << webStats.retries << " retries, "
+         << webStats.hedgedRequests << " hedged requests";
+    return line.str();
+}
 
-    // FIXME: read all input to the string, and process citations in the input text
-    // auto input = readFromFile(argv[3]);
-    // ...
-    // print the paragraph first
+void printWebStats() {
+    /*
+    Print the web lookup statistics to stderr.
+    */
+    std::cerr << formatWebStats() << std::endl;
+}
 
-    // parse command line arguments
-    auto [citationFile, inputFile, outputFile] = parseArgs(argc, argv);
+std::string renderDocument(const std::string& text, const CitationTable& citations, size_t jobs) {
+    /*
+    Render one document for `serve`: the same output a normal run writes for `text`.
+    Errors are reported by `fail`, which throws while serving.
+    */
+    CitationScanner scanner;
+    scanner.scan(text);
+    if (scanner.failed()) {
+        fail("unbalanced brackets");
+    }
+    checkScanned(scanner);
+    auto referenced = findReferences(scanner.citationIDs(), citations);
+    renderAll(referenced, jobs);
+
+    std::ostringstream rendered;
+    {
+        OutputBuffer output{rendered, 1 << 16};
+        outputDocument(text, output, referenced);
+    }
+    return rendered.str();
+}
+
+void serve(const Options& options) {
+    /*
+    Run the "serve" subcommand: a long-running process answering render requests.
+
+    The citations file is loaded once and kept, and so are the web responses, so a request
+    only costs scanning and formatting once the references it needs have been seen. The
+    server listens on `options.serve.host`:`port` (localhost by default) or on a Unix
+    domain socket, and answers:
+
+    - POST /render with a document as the body: the output a normal run would write for
+      it, or status 422 with the reason if the document cannot be rendered.
+    - GET /health: "ok" and the number of loaded citations.
+    - GET /stats, only with `--stats`: the web lookup statistics since the server started.
+
+    The citations file is checked for changes every `reloadIntervalMs` and reloaded when
+    its size or modification time changed. Requests already running keep the table they
+    started with. If the new file is invalid, the previous citations stay in use.
 
-    // load citations from file
-    std::unordered_map<std::string, CitationPtr> citations;
+    Errors in requests must not stop the server, so `fail` throws while serving. Only
+    an invalid citations file at startup or failing to listen ends it with status 1.
+    */
+    namespace fs = std::filesystem;
+    failureThrows = true;
+
+    auto stampOf = [&]() {
+        std::error_code ec;
+        auto size = fs::file_size(options.citationFile, ec);
+        auto mtime = fs::last_write_time(options.citationFile, ec);
+        return std::make_pair(size, mtime);
+    };
+    auto stamp = stampOf();
+
+    std::mutex tableMutex;
+    std::shared_ptr<const CitationTable> table;
     try {
-        citations = loadCitations(citationFile);
+        table = std::make_shared<const CitationTable>(loadCitations(options.citationFile));
     } catch(...) {
         std::exit(1);
     }
+    auto currentTable = [&]() {
+        std::lock_guard<std::mutex> lock{tableMutex};
+        return table;
+    };
+
+    httplib::Server server;
+    server.Post("/render", [&](const httplib::Request& req, httplib::Response& res) {
+        auto citations = currentTable();
+        try {
+            res.set_content(renderDocument(req.body, *citations, options.jobs), "text/plain");
+        } catch(const std::exception& e) {
+            res.status = httplib::UnprocessableContent_422;
+            res.set_content(std::string(e.what()) + "\n", "text/plain");
+        }
+    });
+    server.Get("/health", [&](const httplib::Request&, httplib::Response& res) {
+        res.set_content("ok " + std::to_string(currentTable()->size()) + " citations\n", "text/plain");
+    });
+    if (options.stats) {
+        server.Get("/stats", [&](const httplib::Request&, httplib::Response& res) {
+            res.set_content(formatWebStats() + "\n", "text/plain");
+        });
+    }
 
-    // check if the input file is stdin
-    std::istream* input;
-    if (inputFile == "-") {
-        input = &std::cin;
+    // watch the citations file and swap in a new table when it changed
+    std::mutex stopMutex;
+    std::condition_variable stopped;
+    bool stopping = false;
+    std::thread reloader([&]() {
+        std::unique_lock<std::mutex> lock{stopMutex};
+        auto interval = std::chrono::milliseconds(std::max(options.serve.reloadIntervalMs, 1LL));
+        while (!stopped.wait_for(lock, interval, [&]() { return stopping; })) {
+            auto current = stampOf();
+            if (current == stamp) {
+                continue;
+            }
+            stamp = current;
+            try {
+                auto reloaded = std::make_shared<const CitationTable>(loadCitations(options.citationFile));
+                std::cerr << "serve: reloaded " << reloaded->size() << " citations" << std::endl;
+                std::lock_guard<std::mutex> tableLock{tableMutex};
+                table = std::move(reloaded);
+            } catch(const std::exception& e) {
+                std::cerr << "serve: keeping the previous citations, reload failed: " << e.what() << std::endl;
+            }
+        }
+    });
+
+    bool listening;
+    if (!options.serve.socketPath.empty()) {
+#ifndef _WIN32
+        server.set_address_family(AF_UNIX);
+        std::error_code ec;
+        fs::remove(options.serve.socketPath, ec);
+        std::cerr << "serve: listening on " << options.serve.socketPath << std::endl;
+        listening = server.listen(options.serve.socketPath, 80);
+#else
+        listening = false;
+#endif
     } else {
-        input = new std::ifstream(inputFile);
-        if (!input->good()) {
+        std::cerr << "serve: listening on http://" << options.serve.host << ":" << options.serve.port << std::endl;
+        listening = server.listen(options.serve.host, options.serve.port);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{stopMutex};
+        stopping = true;
+    }
+    stopped.notify_all();
+    reloader.join();
+    if (!listening) {
+        std::exit(1);
+    }
+}
+
+void compileDb(int argc, char** argv) {
+    /*
+    Run the "compile-db" subcommand.
+
+    The expected arguments are "docman", "compile-db", "citations.json", "-o", "index.bin".
+    The citations file is validated and compiled into a binary index that later runs can
+    use with "--index". Any error is handled by calling `std::exit(1)`.
+
+    Args:
+        argc: An integer representing the number of command line arguments.
+        argv: A pointer to an array of C-style strings representing the command line arguments.
+    */
+    if (argc != 5 || std::string(argv[3]) != "-o") {
+        std::exit(1);
+    }
+    try {
+        compileCitationIndex(argv[2], argv[4]);
+    } catch(...) {
+        std::exit(1);
+    }
+}
+
+int main(int argc, char** argv) {
+
+    if (argc > 1 && std::string(argv[1]) == "compile-db") {
+        compileDb(argc, argv);
+        return 0;
+    }
+
+    // parse command line arguments
+    Options options = parseArgs(argc, argv);
+    auto& [citationFile, inputFiles, batchFile, outputFile, jobs, webOptions, stats, lazy, indexFile, serveOptions] = options;
+    webOptions.concurrency = jobs;
+    configureWeb(webOptions);
+
+    if (serveOptions.enabled) {
+        serve(options);
+        return 0;
+    }
+
+    // load citations from file, either now or once the referenced IDs are known;
+    // an up-to-date compiled index replaces the file
+    std::unique_ptr<CitationSource> source;
+    CitationIndex index;
+    if (!indexFile.empty() && index.open(indexFile, citationFile)) {
+        source = std::make_unique<IndexedCitationSource>(index);
+    } else if (lazy) {
+        source = std::make_unique<LazyCitationSource>(citationFile);
+    } else {
+        try {
+            source = std::make_unique<EagerCitationSource>(loadCitations(citationFile));
+        } catch(...) {
             std::exit(1);
         }
     }
 
-    // output the citations to buffer
-    outputCitations(*input, outputBuf, citations);
-
-    // if the input file is not stdin, close the file
-    if (inputFile != "-") {
-        delete input;
+    if (inputFiles.size() > 1 || !batchFile.empty()) {
+        // batch mode: every input gets its own output, named after the input
+        std::error_code ec;
+        if (!outputFile.empty() && !std::filesystem::is_directory(outputFile)
+            && !std::filesystem::create_directories(outputFile, ec)) {
+            std::exit(1);
+        }
+        std::set<std::string> outputFiles;
+        std::vector<BatchInput> inputs(inputFiles.size());
+        for (size_t i = 0; i < inputFiles.size(); i++) {
+            if (inputFiles[i] == "-") {
+                std::exit(1);
+            }
+            inputs[i].inputFile = inputFiles[i];
+            if (outputFile.empty()) {
+                inputs[i].outputFile = inputFiles[i] + ".out";
+            } else {
+                inputs[i].outputFile = (std::filesystem::path(outputFile) / std::filesystem::path(inputFiles[i]).filename()).string();
+            }
+            if (!outputFiles.insert(inputs[i].outputFile).second) {
+                std::exit(1);
+            }
+        }
+        outputBatch(inputs, *source, jobs);
+        if (stats) {
+            printWebStats();
+        }
+        return 0;
     }
 
-    // output the result
-    if (argc == 4) {
-        std::cout << outputBuf.str();
-    } else if (argc == 6) {
-        std::ofstream outputFileStream;
-        outputFileStream.open(outputFile);
-        outputFileStream << outputBuf.str();
+    // regular files are scanned in place and fully validated before anything is written,
+    // stdin and other streams are passed through line by line and published at the end
+    const std::string& inputFile = inputFiles.front();
+    MappedFile mappedInput;
+    try {
+        if (inputFile != "-" && mappedInput.open(inputFile)) {
+            AtomicOutput output{outputFile, false};
+            outputCitations(mappedInput.view(), output.buffer(), *source, jobs);
+            output.commit();
+        } else {
+            std::ifstream inputFileStream;
+            if (inputFile != "-") {
+                inputFileStream.open(inputFile);
+                if (!inputFileStream.good()) {
+                    std::exit(1);
+                }
+            }
+            std::istream& input = inputFile == "-" ? std::cin : inputFileStream;
+
+            AtomicOutput output{outputFile, true};
+            outputCitations(input, output.buffer(), *source, jobs);
+            output.commit();
+        }
+    } catch(const DocmanError&) {
+        std::exit(1);
     }
 
+    if (stats) {
+        printWebStats();
+    }
 }
@@ -0,0 +1,65 @@
+#include "./mapped_file.h"
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
+
+bool MappedFile::open(const std::string& path) {
+    /*
+    This function is used to map the file at `path`.
+    It returns false if the file cannot be opened or is not a regular file.
+    */
+#ifdef _WIN32
+    std::ifstream file{path, std::ios::binary};
+    if (!file.good()) {
+        return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    size = static_cast<size_t>(info.st_size);
+    if (size > 0) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            size = 0;
+            return false;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+    }
+    close(fd);
+    return true;
+#endif
+}
+
+std::string_view MappedFile::view() const {
+    return std::string_view(data, size);
+}
@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+class MappedFile {
+/*
+A read-only view of a whole regular file.
+
+On POSIX systems the file is memory-mapped, so its bytes can be scanned and written out
+in place without being copied into per-line strings. Elsewhere the file is read into a
+buffer once. `open` fails for anything that is not a regular file (pipes, terminals, ...),
+callers should fall back to reading those as a stream.
+*/
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    std::string buffer;
+#endif
+public:
+    ~MappedFile();
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    std::string_view view() const;
+};
+
+#endif
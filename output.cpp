@@ -0,0 +1,194 @@
+#include "./output.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "./utils.hpp"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static std::mutex pendingMutex;
+static std::set<std::string> pendingFiles;
+
+static void removePendingFiles() {
+    std::lock_guard<std::mutex> lock{pendingMutex};
+    std::error_code ec;
+    for (auto& path : pendingFiles) {
+        fs::remove(path, ec);
+    }
+    pendingFiles.clear();
+}
+
+static std::string makeTemporaryPath(const fs::path& near) {
+    /*
+    This function is used to pick a fresh temporary file name next to `near` and to
+    register it for removal at exit.
+    */
+    static std::once_flag registerCleanup;
+    std::call_once(registerCleanup, []() { std::atexit(removePendingFiles); });
+
+    std::stringstream name;
+    name << near.string() << ".tmp." << std::hex << std::random_device{}() << std::random_device{}();
+
+    std::lock_guard<std::mutex> lock{pendingMutex};
+    pendingFiles.insert(name.str());
+    return name.str();
+}
+
+static void forgetTemporaryPath(const std::string& path) {
+    std::lock_guard<std::mutex> lock{pendingMutex};
+    pendingFiles.erase(path);
+}
+
+static void copyFileAttributes(const std::string& from, const std::string& to) {
+    /*
+    This function is used to give a temporary file the owner, group and permissions of the
+    file it is about to replace. An owner or group the current user cannot hand the file
+    to is left as it is.
+    */
+    std::error_code ec;
+    auto status = fs::status(from, ec);
+    if (ec || !fs::exists(status)) {
+        return;
+    }
+#ifndef _WIN32
+    struct stat info;
+    if (::stat(from.c_str(), &info) == 0 && chown(to.c_str(), info.st_uid, info.st_gid) != 0) {
+        // only root can give a file away, but its owner may still keep the group
+        static_cast<void>(chown(to.c_str(), static_cast<uid_t>(-1), info.st_gid) == 0);
+    }
+#endif
+    fs::permissions(to, status.permissions(), ec);
+}
+
+// OutputBuffer class
+
+OutputBuffer::OutputBuffer(std::ostream& sink, size_t capacity) : sink(sink), buffer(capacity) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::flush() {
+    if (used > 0) {
+        sink.write(buffer.data(), used);
+        used = 0;
+    }
+}
+
+// AtomicOutput class
+
+AtomicOutput::AtomicOutput(const std::string& path, bool spool) {
+    /*
+    This function is used to open the temporary file the output goes to, if any, and the
+    target itself if it cannot be replaced by renaming.
+    */
+    std::error_code ec;
+    auto status = path.empty() ? fs::file_status{} : fs::status(path, ec);
+    bool hardLinked = fs::is_regular_file(status) && fs::hard_link_count(path, ec) > 1;
+    if (!path.empty() && !hardLinked && (status.type() == fs::file_type::not_found || fs::is_regular_file(status))) {
+        this->path = (fs::exists(status) ? fs::canonical(path, ec) : fs::weakly_canonical(path, ec)).string();
+        if (ec) {
+            throw DocmanError("cannot resolve " + path);
+        }
+        tmpPath = makeTemporaryPath(this->path);
+    } else {
+        if (path.empty()) {
+            sink = &std::cout;
+        } else {
+            // a hard-linked file that is spooled to is only truncated by `commit`
+            if (hardLinked && spool) {
+                truncatePath = path;
+            }
+            target.open(path, std::ios::binary | (hardLinked && spool ? std::ios::in | std::ios::out : std::ios::trunc));
+            if (!target.is_open()) {
+                throw DocmanError("cannot open " + path);
+            }
+            sink = &target;
+        }
+        if (!spool) {
+            out = std::make_unique<OutputBuffer>(*sink);
+            return;
+        }
+        tmpPath = makeTemporaryPath(fs::temp_directory_path() / "docman");
+    }
+
+    file.open(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        forgetTemporaryPath(tmpPath);
+        throw DocmanError("cannot create " + tmpPath);
+    }
+    out = std::make_unique<OutputBuffer>(file);
+}
+
+AtomicOutput::~AtomicOutput() {
+    if (!committed && !tmpPath.empty()) {
+        out.reset();
+        file.close();
+        std::error_code ec;
+        fs::remove(tmpPath, ec);
+        forgetTemporaryPath(tmpPath);
+    }
+}
+
+OutputBuffer& AtomicOutput::buffer() {
+    return *out;
+}
+
+void AtomicOutput::commit() {
+    /*
+    This function is used to publish the complete output.
+    */
+    out->flush();
+    if (tmpPath.empty()) {
+        sink->flush();
+        committed = true;
+        if (target.is_open() && target.fail()) {
+            throw DocmanError("cannot write the output");
+        }
+        return;
+    }
+
+    file.close();
+    if (file.fail()) {
+        throw DocmanError("cannot write " + tmpPath);
+    }
+
+    std::error_code ec;
+    if (!path.empty()) {
+        copyFileAttributes(path, tmpPath);
+        fs::rename(tmpPath, path, ec);
+        if (ec) {
+            throw DocmanError("cannot replace " + path);
+        }
+    } else {
+        if (!truncatePath.empty()) {
+            fs::resize_file(truncatePath, 0, ec);
+            if (ec) {
+                throw DocmanError("cannot truncate " + truncatePath);
+            }
+        }
+        std::ifstream spooled{tmpPath, std::ios::binary};
+        if (spooled.peek() != std::ifstream::traits_type::eof()) {
+            *sink << spooled.rdbuf();
+        }
+        sink->flush();
+        spooled.close();
+        fs::remove(tmpPath, ec);
+    }
+    forgetTemporaryPath(tmpPath);
+    committed = true;
+    if (target.is_open() && target.fail()) {
+        throw DocmanError("cannot write the output");
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class OutputBuffer {
+/*
+A large, reusable write buffer in front of an output stream.
+
+Small writes (lines, references) are collected and handed to the stream in blocks of
+`capacity` bytes, writes larger than the buffer go straight through. Nothing is flushed
+per line: data only reaches the stream when the buffer is full or at an explicit `flush`.
+*/
+
+private:
+    std::ostream& sink;
+    std::vector<char> buffer;
+    size_t used = 0;
+public:
+    ~OutputBuffer();
+
+    explicit OutputBuffer(std::ostream& sink, size_t capacity = 1 << 20);
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    OutputBuffer& write(std::string_view text) {
+        if (text.size() > buffer.size() - used) {
+            flush();
+            if (text.size() >= buffer.size()) {
+                sink.write(text.data(), text.size());
+                return *this;
+            }
+        }
+        std::memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+        return *this;
+    }
+
+    OutputBuffer& put(char c) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = c;
+        return *this;
+    }
+
+    void flush();
+};
+
+class AtomicOutput {
+/*
+An output destination that only becomes visible once it is complete.
+
+Output for a regular file, or a path that does not exist yet, is written to a temporary
+file next to it and renamed over the destination by `commit`; symlinks are followed, so
+the file they point to is replaced, and the new file keeps its permissions and, where
+allowed, its owner. Output for stdout (an empty path) or any other existing target (a
+FIFO, a device, "/dev/fd/N", a file with several hard links) is either written directly,
+when the caller has validated everything before writing, or spooled to a temporary file
+and copied to the target by `commit`. Temporary files that were never committed are removed, also
+when the program stops through `std::exit`. All writes go through one `OutputBuffer`,
+which `commit` flushes.
+
+Errors are reported by throwing a `DocmanError`, so outputs can be written on worker
+threads (see `parallelFor`).
+*/
+
+private:
+    std::string path;                           // where `commit` renames the temporary file to
+    std::string tmpPath;
+    std::ofstream file;
+    std::ofstream target;                       // an opened target that cannot be renamed over
+    std::string truncatePath;                   // a spooled-to target that `commit` truncates first
+    std::ostream* sink = nullptr;               // where spooled output is copied by `commit`
+    std::unique_ptr<OutputBuffer> out;
+    bool committed = false;
+public:
+    ~AtomicOutput();
+
+    AtomicOutput(const std::string& path, bool spool);
+    AtomicOutput(const AtomicOutput&) = delete;
+    AtomicOutput& operator=(const AtomicOutput&) = delete;
+
+    OutputBuffer& buffer();
+    void commit();
+};
+
+#endif
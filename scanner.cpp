@@ -0,0 +1,229 @@
+#include "./scanner.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "./utils.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DOCMAN_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+template <bool lineBreaks>
+static inline bool isSpecial(char c) {
+    return c == '[' || c == ']' || (lineBreaks && (c == '\n' || c == '\r'));
+}
+
+template <bool lineBreaks>
+static size_t findSpecialScalar(const char* text, size_t from, size_t size) {
+    /*
+    This function is used to find the next byte that can change the scanner state,
+    i.e. a bracket, or also a line break while a citation ID is open (`lineBreaks`).
+    It returns `size` if there is none.
+    */
+    for (size_t i = from; i < size; i++) {
+        if (isSpecial<lineBreaks>(text[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+#ifdef DOCMAN_X86_SIMD
+
+template <bool lineBreaks>
+__attribute__((target("sse2")))
+static size_t findSpecialSSE2(const char* text, size_t from, size_t size) {
+    const __m128i open = _mm_set1_epi8('['), close = _mm_set1_epi8(']');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    size_t i = from;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, open), _mm_cmpeq_epi8(v, close));
+        if (lineBreaks) {
+            hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        }
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return findSpecialScalar<lineBreaks>(text, i, size);
+}
+
+template <bool lineBreaks>
+__attribute__((target("avx2")))
+static size_t findSpecialAVX2(const char* text, size_t from, size_t size) {
+    const __m256i open = _mm256_set1_epi8('['), close = _mm256_set1_epi8(']');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    size_t i = from;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, open), _mm256_cmpeq_epi8(v, close));
+        if (lineBreaks) {
+            hit = _mm256_or_si256(hit, _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        }
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return findSpecialSSE2<lineBreaks>(text, i, size);
+}
+
+#endif
+
+bool CitationScanner::supported(ScanKernel kernel) {
+    switch (kernel) {
+    case ScanKernel::Auto:
+    case ScanKernel::Scalar:
+        return true;
+#ifdef DOCMAN_X86_SIMD
+    case ScanKernel::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case ScanKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+CitationScanner::CitationScanner(ScanKernel kernel) {
+    /*
+    This function is used to pick the search kernel. An unsupported kernel falls back to
+    the best supported one.
+    */
+    if (!supported(kernel)) {
+        kernel = ScanKernel::Auto;
+    }
+    if (kernel == ScanKernel::Auto) {
+        kernel = supported(ScanKernel::AVX2) ? ScanKernel::AVX2
+               : supported(ScanKernel::SSE2) ? ScanKernel::SSE2
+               : ScanKernel::Scalar;
+    }
+
+    findBracket = findSpecialScalar<false>;
+    findSpecial = findSpecialScalar<true>;
+#ifdef DOCMAN_X86_SIMD
+    if (kernel == ScanKernel::AVX2) {
+        findBracket = findSpecialAVX2<false>;
+        findSpecial = findSpecialAVX2<true>;
+    } else if (kernel == ScanKernel::SSE2) {
+        findBracket = findSpecialSSE2<false>;
+        findSpecial = findSpecialSSE2<true>;
+    }
+#endif
+}
+
+static void scanLines(
+    CitationScanner::FindFn findBracket,
+    CitationScanner::FindFn findSpecial,
+    std::string_view text,
+    long long& bracketCount,
+    long long& minimum,
+    std::set<std::string>& ids
+) {
+    /*
+    This function is used to scan a block of complete lines.
+    It balances brackets and extracts citation IDs in the same pass. An ID starts at the
+    first "[" after the previous ID and ends at the next "]"; a line break ("\n" or "\r",
+    which "." does not match) before that "]" drops the pending "[". Only those four
+    bytes matter, and line breaks only while an ID is open; everything else is skipped
+    by the search kernel.
+    `minimum` is lowered to the smallest bracket count reached after any "]".
+    */
+    const char* data = text.data();
+    size_t size = text.size();
+    size_t open = std::string_view::npos;
+    auto next = [&](size_t from) {
+        return open == std::string_view::npos ? findBracket(data, from, size) : findSpecial(data, from, size);
+    };
+    for (size_t i = next(0); i < size; i = next(i + 1)) {
+        char c = data[i];
+        if (c == '[') {
+            ++bracketCount;
+            if (open == std::string_view::npos) {
+                open = i;
+            }
+        } else if (c == ']') {
+            if (--bracketCount < minimum) {
+                minimum = bracketCount;
+            }
+            if (open != std::string_view::npos) {
+                ids.emplace(text.substr(open + 1, i - open - 1));
+                open = std::string_view::npos;
+            }
+        } else {
+            open = std::string_view::npos;
+        }
+    }
+}
+
+void CitationScanner::scan(std::string_view text) {
+    long long minimum = bracketCount;
+    scanLines(findBracket, findSpecial, text, bracketCount, minimum, ids);
+    if (minimum < 0) {
+        negative = true;
+    }
+}
+
+void CitationScanner::scan(std::string_view text, size_t threads) {
+    /*
+    This function is used to scan a large block of complete lines on several threads.
+
+    The text is cut into chunks at line breaks, so no chunk starts inside a pending
+    citation. Each chunk is scanned on its own, from a bracket count of zero, for its IDs,
+    its bracket count delta and the lowest count it reaches. Merging the chunks in order
+    then gives exactly the result of `scan(text)`: the count went negative somewhere iff
+    the count before a chunk plus that chunk's lowest count is negative.
+    */
+    size_t chunks = std::min(threads, text.size() / minParallelChunk);
+    if (chunks <= 1) {
+        scan(text);
+        return;
+    }
+
+    std::vector<size_t> bounds{0};
+    for (size_t k = 1; k < chunks; k++) {
+        size_t cut = std::max(text.size() / chunks * k, bounds.back());
+        while (cut < text.size() && text[cut] != '\n' && text[cut] != '\r') {
+            cut++;
+        }
+        bounds.push_back(std::min(cut + 1, text.size()));
+    }
+    bounds.push_back(text.size());
+
+    struct Chunk {
+        long long bracketCount = 0;
+        long long minimum = 0;
+        std::set<std::string> ids;
+    };
+    std::vector<Chunk> results(chunks);
+    parallelFor(chunks, chunks, [&](size_t k) {
+        auto& chunk = results[k];
+        scanLines(findBracket, findSpecial, text.substr(bounds[k], bounds[k + 1] - bounds[k]), chunk.bracketCount, chunk.minimum, chunk.ids);
+    });
+
+    for (auto& chunk : results) {
+        if (bracketCount + chunk.minimum < 0) {
+            negative = true;
+        }
+        bracketCount += chunk.bracketCount;
+        ids.merge(chunk.ids);
+    }
+}
+
+bool CitationScanner::failed() const {
+    // more "]" than "[" at some point
+    return negative;
+}
+
+bool CitationScanner::balanced() const {
+    return !negative && bracketCount == 0;
+}
+
+const std::set<std::string>& CitationScanner::citationIDs() const {
+    return ids;
+}
@@ -0,0 +1,54 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <string_view>
+
+enum class ScanKernel {
+    Auto,       // the fastest kernel supported by the CPU
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+class CitationScanner {
+/*
+Single-pass scanner for citations in the input text.
+
+The scanner keeps a running count of "[" and "]" across everything it has seen and
+collects the text between each "[" and the first "]" after it on the same line as a
+citation ID, which is exactly what the pattern "\[(.*?)\]" matches line by line. Text
+must be fed in whole lines, either one line at a time or a block of "\n"-separated lines.
+
+Bytes that cannot change the scanner state are skipped 16 (SSE2) or 32 (AVX2) at a
+time, line breaks included while no citation is open; the kernel is picked at runtime
+unless one is requested explicitly. Large blocks can be scanned on several threads, with
+the same result.
+*/
+
+public:
+    using FindFn = size_t (*)(const char* text, size_t from, size_t size);
+private:
+    FindFn findBracket;                         // "[" or "]"
+    FindFn findSpecial;                         // also "\n" or "\r"
+    long long bracketCount = 0;
+    bool negative = false;
+    std::set<std::string> ids;
+public:
+    static constexpr size_t minParallelChunk = 1 << 20;
+
+    CitationScanner(ScanKernel kernel = ScanKernel::Auto);
+
+    void scan(std::string_view text);
+    void scan(std::string_view text, size_t threads);
+
+    bool failed() const;
+    bool balanced() const;
+    const std::set<std::string>& citationIDs() const;
+
+    static bool supported(ScanKernel kernel);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string>
+
+#include "mock_api.hpp"
+
+int main(int argc, char** argv) {
+    /*
+    Run the stand-in metadata API on localhost, e.g. to try batch requests or to test
+    docman without network access:
+
+    - "docman_mock_api", [port=8080], ["--batch-endpoint", "/batch"], ["--no-batch"], ["--latency", "MS"]
+
+    Then point docman at it with "--endpoint http://127.0.0.1:<port>".
+    */
+    int port = 8080;
+    MockApiOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--batch-endpoint" && hasValue) {
+            options.batchPath = argv[++i];
+        } else if (arg == "--no-batch") {
+            options.batchPath.clear();
+        } else if (arg == "--latency" && hasValue) {
+            options.latencyMs = std::stoi(argv[++i]);
+        } else if (!arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos) {
+            port = std::stoi(arg);
+        } else {
+            std::cerr << "usage: docman_mock_api [port] [--batch-endpoint PATH] [--no-batch] [--latency MS]" << std::endl;
+            return 1;
+        }
+    }
+
+    httplib::Server server;
+    installMockApi(server, options);
+    std::cerr << "mock API listening on http://127.0.0.1:" << port << std::endl;
+    if (!server.listen("127.0.0.1", port)) {
+        std::cerr << "cannot listen on port " << port << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef MOCK_API_HPP
+#define MOCK_API_HPP
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "cpp-httplib/httplib.h"
+#include "nlohmann/json.hpp"
+
+struct MockApiOptions {
+    std::string batchPath = "/batch";           // empty: no batch endpoint
+    int latencyMs = 0;                          // added to every response
+};
+
+inline nlohmann::json mockBook(const std::string& isbn) {
+    return {
+        {"author", "Author of " + isbn},
+        {"title", "Book " + isbn},
+        {"publisher", "Mock Press"},
+        {"year", "2001"}
+    };
+}
+
+inline nlohmann::json mockWebPage(const std::string& url) {
+    return {{"title", "Page at " + url}};
+}
+
+inline void installMockApi(httplib::Server& server, const MockApiOptions& options = MockApiOptions()) {
+    /*
+    Install a stand-in for the metadata API on `server`.
+
+    "/isbn/<isbn>" and "/title/<url>" answer with made-up but well-formed book and webpage
+    metadata derived from the key, so any citation renders. If `options.batchPath` is set,
+    a POST of {"resources": [...]} to it answers with an object mapping each of these
+    resources to the response the single request would have given; unknown resources are
+    left out. Without a batch path the server behaves like one without batch support.
+    */
+    // responses are written as headers then body, which must not wait on a delayed ACK
+    server.set_tcp_nodelay(true);
+
+    auto delay = [latency = options.latencyMs]() {
+        if (latency > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(latency));
+        }
+    };
+
+    server.Get(R"(/isbn/(.+))", [delay](const httplib::Request& req, httplib::Response& res) {
+        delay();
+        res.set_content(mockBook(req.matches[1]).dump(), "application/json");
+    });
+    server.Get(R"(/title/(.+))", [delay](const httplib::Request& req, httplib::Response& res) {
+        delay();
+        res.set_content(mockWebPage(req.matches[1]).dump(), "application/json");
+    });
+
+    if (options.batchPath.empty()) {
+        return;
+    }
+    server.Post(options.batchPath, [delay](const httplib::Request& req, httplib::Response& res) {
+        delay();
+        auto request = nlohmann::json::parse(req.body, nullptr, false);
+        if (!request.is_object() || !request.contains("resources") || !request["resources"].is_array()) {
+            res.status = httplib::BadRequest_400;
+            return;
+        }
+        nlohmann::json results = nlohmann::json::object();
+        for (auto& resource : request["resources"]) {
+            if (!resource.is_string()) {
+                continue;
+            }
+            auto& path = resource.get_ref<const std::string&>();
+            std::string decoded = httplib::detail::decode_url(path, false);
+            if (decoded.rfind("/isbn/", 0) == 0 && decoded.size() > 6) {
+                results[path] = mockBook(decoded.substr(6));
+            } else if (decoded.rfind("/title/", 0) == 0 && decoded.size() > 7) {
+                results[path] = mockWebPage(decoded.substr(7));
+            }
+        }
+        res.set_content(results.dump(), "application/json");
+    });
+}
+
+#endif
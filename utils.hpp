@@ -2,29 +2,181 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
 #include <string>
-#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 const std::string API_ENDPOINT{"http://docman.lcpu.dev"};
 
-inline std::string encodeUriComponent(const std::string& s) {
-    std::string encoded;
-    char c;
-    for (size_t i = 0; i < s.length(); i++) {
-        c = s[i];
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            encoded += c;
-        } else if (c == ' ') {
-            encoded += '+';
+class DocmanError : public std::runtime_error {
+/*
+An invalid input, citation or response, thrown by `fail` when errors must not end the
+process (see `docman serve`) or happen on a worker thread (see `parallelFor`).
+*/
+
+public:
+    using std::runtime_error::runtime_error;
+};
+
+inline std::atomic<bool> failureThrows{false};
+inline thread_local size_t parallelDepth = 0;
+
+[[noreturn]] inline void fail(const std::string& reason = "invalid input") {
+    /*
+    Give up on the current document: exit with status 1, or throw a `DocmanError` once
+    `failureThrows` is set by a long-running process that serves many documents.
+
+    Inside `parallelFor` it always throws, so that only the calling thread exits, once
+    every worker has finished.
+    */
+    if (failureThrows || parallelDepth > 0) {
+        throw DocmanError(reason);
+    }
+    std::exit(1);
+}
+
+inline constexpr auto uriUnreserved = []() {
+    // the unreserved bytes of RFC 3986, which are never percent-encoded
+    std::array<bool, 256> table{};
+    for (int c = '0'; c <= '9'; c++) {
+        table[c] = true;
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        table[c] = true;
+        table[c - 'A' + 'a'] = true;
+    }
+    table['-'] = table['_'] = table['.'] = table['~'] = true;
+    return table;
+}();
+
+inline size_t uriUnreservedRun(const char* text, size_t from, size_t size) {
+    /*
+    Return the end of the run of unreserved bytes starting at `from`. With SSE2, 16 bytes
+    are classified at a time.
+    */
+    size_t i = from;
+#ifdef __SSE2__
+    auto inRange = [](__m128i v, char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+    };
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i ok = _mm_or_si128(
+            _mm_or_si128(inRange(v, 'a', 'z'), inRange(v, 'A', 'Z')),
+            _mm_or_si128(inRange(v, '0', '9'), _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')), _mm_cmpeq_epi8(v, _mm_set1_epi8('~')))
+            ))
+        );
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ok));
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+    while (i < size && uriUnreserved[static_cast<unsigned char>(text[i])]) {
+        i++;
+    }
+    return i;
+}
+
+inline std::string encodeUriComponent(std::string_view s) {
+    /*
+    Percent-encode `s` for use as one path segment of an API request.
+
+    Unreserved bytes are copied as they are (runs of them in one go), a space becomes "+"
+    and every other byte, including each byte of a UTF-8 sequence, becomes "%XX" with two
+    uppercase hex digits.
+    */
+    static constexpr char hex[] = "0123456789ABCDEF";
+    std::string encoded(s.size() * 3, '\0');
+    char* out = encoded.data();
+    for (size_t i = 0; i < s.size(); ) {
+        size_t end = uriUnreservedRun(s.data(), i, s.size());
+        std::memcpy(out, s.data() + i, end - i);
+        out += end - i;
+        if (end == s.size()) {
+            break;
+        }
+        auto c = static_cast<unsigned char>(s[end]);
+        if (c == ' ') {
+            *out++ = '+';
         } else {
-            encoded += '%';
-            // convert to hex
-            std::stringstream ss;
-            ss << std::hex << (int) c;
-            encoded += ss.str();
+            *out++ = '%';
+            *out++ = hex[c >> 4];
+            *out++ = hex[c & 15];
         }
+        i = end + 1;
     }
+    encoded.resize(out - encoded.data());
     return encoded;
 }
 
+template <typename Fn>
+void parallelFor(size_t count, size_t jobs, Fn&& fn) {
+    /*
+    Call `fn(i)` for every i in [0, count) on at most `jobs` threads.
+
+    Indices are handed out one at a time, so slow items (e.g. web lookups) do not hold
+    up the rest. The first exception thrown by `fn` is rethrown on the calling thread
+    after all workers have finished. `fail` throws instead of exiting while `fn` runs.
+    */
+    struct ParallelSection {
+        ParallelSection() { parallelDepth++; }
+        ~ParallelSection() { parallelDepth--; }
+    };
+
+    jobs = std::max<size_t>(1, std::min(jobs, count));
+    if (jobs == 1) {
+        ParallelSection section;
+        for (size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto worker = [&]() {
+        ParallelSection section;
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock{errorMutex};
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < jobs; t++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
 #endif 
@@ -0,0 +1,690 @@
+#include "./web.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "./cache.h"
+#include "cpp-httplib/httplib.h"
+#include "nlohmann/json.hpp"
+
+class ClientPool {
+/*
+A pool of keep-alive HTTP clients to the API endpoint.
+
+Each lookup leases one client for the duration of its request and returns it afterwards,
+so the next lookup (possibly on another thread) reuses the open connection instead of
+paying for DNS, TCP setup and slow start again. The pool only grows to the number of
+lookups that are in flight at the same time.
+*/
+
+private:
+    std::mutex mutex;
+    std::string endpoint = API_ENDPOINT;
+    std::vector<std::unique_ptr<httplib::Client>> idle;
+public:
+    void reset(const std::string& endpoint);
+    std::unique_ptr<httplib::Client> acquire();
+    void release(std::unique_ptr<httplib::Client> client);
+};
+
+class LatencyTracker {
+/*
+The latencies of the most recent successful requests, used to decide when a request is
+slow enough to be hedged. Only a fixed number of samples is kept, so the estimate
+follows the endpoint when it speeds up or slows down.
+*/
+
+private:
+    static constexpr size_t capacity = 256;
+    static constexpr size_t minSamples = 20;
+    std::mutex mutex;
+    std::vector<std::chrono::milliseconds> samples;
+    size_t next = 0;
+public:
+    void reset();
+    void add(std::chrono::milliseconds latency);
+    std::optional<std::chrono::milliseconds> p95();
+};
+
+class Watchdog {
+/*
+Cuts requests short once their lookup's deadline has passed.
+
+The connect and read timeouts of a client only bound each step of a request (a server
+that trickles its response byte by byte never hits the read timeout), so every request
+is registered here with its deadline. A single background thread, started on first use,
+calls `stop` on the clients whose deadline has passed, which makes their request fail
+right away. A request must be unregistered before its client is reused or destroyed.
+*/
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::map<std::pair<Clock::time_point, std::uint64_t>, httplib::Client*> armed;
+    std::uint64_t nextId = 0;
+    std::thread thread;
+    bool stopping = false;
+
+    void watch();
+public:
+    using Token = std::pair<Clock::time_point, std::uint64_t>;
+
+    ~Watchdog();
+
+    Token arm(httplib::Client& client, Clock::time_point deadline);
+    void disarm(Token token);
+};
+
+class FetchExecutor {
+/*
+A bounded set of threads that run the web lookups started with `getFromWebAsync`, one
+lookup per thread at a time.
+
+Threads are started as lookups are queued, while no started thread is idle, up to the
+given number; they are kept for later lookups. Lookups that are still queued when the
+program exits are dropped, the ones already running are waited for (they are bounded by
+the request timeouts and deadline).
+*/
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> queue;
+    std::vector<std::thread> workers;
+    size_t idle = 0;                            // threads not running a lookup, including ones starting up
+    bool stopping = false;
+
+    void work();
+public:
+    ~FetchExecutor();
+
+    void submit(std::function<void()> task, size_t threads);
+};
+
+static WebOptions webOptions;
+static ClientPool clientPool;
+static std::unique_ptr<DiskCache> diskCache = std::make_unique<DiskCache>();
+static std::atomic<size_t> cacheHits{0};
+static std::atomic<size_t> requestCount{0};
+static std::atomic<size_t> connectionsOpened{0};
+static std::atomic<size_t> connectionsReused{0};
+static std::atomic<size_t> retryCount{0};
+static std::atomic<size_t> hedgedRequests{0};
+static LatencyTracker latencies;
+static Watchdog watchdog;
+static std::atomic<size_t> batchRequests{0};
+static std::atomic<size_t> batchedResources{0};
+static std::atomic<bool> batchSupported{true};
+static std::atomic<size_t> coalescedRequests{0};
+static std::mutex lookupMutex;
+static std::unordered_map<std::string, std::string> prefetched;
+static std::unordered_map<std::string, std::string> fetched;
+static std::unordered_map<std::string, std::shared_future<std::string>> inFlight;
+static FetchExecutor fetchExecutor;
+
+void ClientPool::reset(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock{mutex};
+    this->endpoint = endpoint;
+    idle.clear();
+}
+
+std::unique_ptr<httplib::Client> ClientPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!idle.empty()) {
+            auto client = std::move(idle.back());
+            idle.pop_back();
+            return client;
+        }
+    }
+    auto client = std::make_unique<httplib::Client>(endpoint);
+    client->set_keep_alive(true);
+    // a batch POST is written as headers then body, which must not wait on a delayed ACK
+    client->set_tcp_nodelay(true);
+    return client;
+}
+
+void ClientPool::release(std::unique_ptr<httplib::Client> client) {
+    std::lock_guard<std::mutex> lock{mutex};
+    idle.push_back(std::move(client));
+}
+
+void LatencyTracker::reset() {
+    std::lock_guard<std::mutex> lock{mutex};
+    samples.clear();
+    next = 0;
+}
+
+void LatencyTracker::add(std::chrono::milliseconds latency) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (samples.size() < capacity) {
+        samples.push_back(latency);
+    } else {
+        samples[next] = latency;
+        next = (next + 1) % capacity;
+    }
+}
+
+std::optional<std::chrono::milliseconds> LatencyTracker::p95() {
+    /*
+    The 95th percentile of the recorded latencies, or nothing until there are enough
+    samples for it to mean anything.
+    */
+    std::vector<std::chrono::milliseconds> sorted;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (samples.size() < minSamples) {
+            return std::nullopt;
+        }
+        sorted = samples;
+    }
+    auto p95 = sorted.begin() + sorted.size() * 95 / 100;
+    std::nth_element(sorted.begin(), p95, sorted.end());
+    return *p95;
+}
+
+Watchdog::~Watchdog() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+Watchdog::Token Watchdog::arm(httplib::Client& client, Clock::time_point deadline) {
+    Token token;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!thread.joinable()) {
+            thread = std::thread(&Watchdog::watch, this);
+        }
+        token = {deadline, nextId++};
+        armed.emplace(token, &client);
+    }
+    wake.notify_one();
+    return token;
+}
+
+void Watchdog::disarm(Token token) {
+    // holding the lock, so `stop` is not called on the client after this returns; the
+    // entry is already gone if the deadline has passed
+    std::lock_guard<std::mutex> lock{mutex};
+    armed.erase(token);
+}
+
+void Watchdog::watch() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (!stopping) {
+        if (armed.empty()) {
+            wake.wait(lock);
+            continue;
+        }
+        auto first = armed.begin();
+        auto deadline = first->first.first;     // a copy, the entry may go away while waiting
+        if (deadline > Clock::now()) {
+            wake.wait_until(lock, deadline);
+            continue;
+        }
+        first->second->stop();
+        armed.erase(first);
+    }
+}
+
+FetchExecutor::~FetchExecutor() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+        queue.clear();
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void FetchExecutor::submit(std::function<void()> task, size_t threads) {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        queue.push_back(std::move(task));
+        if (queue.size() > idle && workers.size() < std::max<size_t>(threads, 1)) {
+            ++idle;
+            workers.emplace_back(&FetchExecutor::work, this);
+        }
+    }
+    wake.notify_one();
+}
+
+void FetchExecutor::work() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true) {
+        wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        auto task = std::move(queue.front());
+        queue.pop_front();
+        --idle;
+        lock.unlock();
+        task();
+        lock.lock();
+        ++idle;
+    }
+}
+
+void configureWeb(const WebOptions& options) {
+    /*
+    Set the options used by all following web lookups. This must be called before any
+    lookup is started.
+    */
+    webOptions = options;
+    clientPool.reset(options.endpoint);
+    batchSupported = !options.batchPath.empty();
+    prefetched.clear();
+    fetched.clear();
+    inFlight.clear();
+    latencies.reset();
+    if (options.cacheDir.empty()) {
+        diskCache = std::make_unique<DiskCache>();
+    } else {
+        diskCache = std::make_unique<DiskCache>(options.cacheDir, options.cacheTtl, options.cacheMaxBytes);
+    }
+}
+
+enum class Outcome {
+    OK,
+    RETRY,
+    FAIL
+};
+
+struct Attempt {
+    Outcome outcome;
+    std::string body;                           // the response body if OK, an error message otherwise
+};
+
+static std::chrono::milliseconds clampedMs(long long ms) {
+    // durations from the command line may be up to 18 digits, which would overflow the
+    // steady clock; nothing here needs to wait longer than a year
+    return std::chrono::milliseconds(std::min(ms, 365LL * 24 * 60 * 60 * 1000));
+}
+
+static std::unique_ptr<httplib::Client> leaseClient(std::chrono::milliseconds remaining) {
+    /*
+    Take a client from the pool with its timeouts set for a request that must finish
+    within `remaining`.
+    */
+    auto client = clientPool.acquire();
+    if (client->is_socket_open()) {
+        ++connectionsReused;
+    } else {
+        ++connectionsOpened;
+    }
+    client->set_connection_timeout(std::min(std::chrono::milliseconds(webOptions.connectTimeoutMs), remaining));
+    client->set_read_timeout(std::min(std::chrono::milliseconds(webOptions.readTimeoutMs), remaining));
+    client->set_write_timeout(std::min(std::chrono::milliseconds(webOptions.readTimeoutMs), remaining));
+    return client;
+}
+
+static Attempt request(httplib::Client& client, const std::string& resource, std::chrono::steady_clock::time_point deadline) {
+    /*
+    Send one GET request, cut short by the watchdog at `deadline`. Connection errors,
+    timeouts, 429 and 5xx responses are worth retrying, any other response that is not
+    200 is final.
+    */
+    ++requestCount;
+    auto start = std::chrono::steady_clock::now();
+    auto token = watchdog.arm(client, deadline);
+    auto res = client.Get(resource, [&](uint64_t, uint64_t) {
+        return std::chrono::steady_clock::now() < deadline;
+    });
+    watchdog.disarm(token);
+    if (!res) {
+        return {Outcome::RETRY, httplib::to_string(res.error())};
+    }
+    if (res->status == httplib::OK_200) {
+        latencies.add(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start));
+        return {Outcome::OK, std::move(res->body)};
+    }
+    std::string error = "HTTP " + std::to_string(res->status);
+    if (res->status == httplib::TooManyRequests_429 || res->status >= 500) {
+        return {Outcome::RETRY, error};
+    }
+    return {Outcome::FAIL, error};
+}
+
+static Attempt attemptFetch(const std::string& resource, std::chrono::steady_clock::time_point deadline) {
+    /*
+    Fetch `resource` once, giving up at `deadline`. With hedging enabled, a second request
+    for it is sent on another connection once the first one has taken longer than the
+    recent p95 latency, and whichever succeeds first is used; the other one is cancelled.
+    */
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    auto primaryClient = leaseClient(remaining);
+    auto hedgeDelay = webOptions.hedge ? latencies.p95() : std::nullopt;
+    if (!hedgeDelay || *hedgeDelay >= remaining) {
+        auto result = request(*primaryClient, resource, deadline);
+        if (result.outcome != Outcome::RETRY) {
+            clientPool.release(std::move(primaryClient));
+        }
+        return result;
+    }
+
+    std::unique_ptr<httplib::Client> hedgeClient;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::optional<Attempt> results[2];
+    auto run = [&](httplib::Client* client, size_t which) {
+        auto result = request(*client, resource, deadline);
+        std::lock_guard<std::mutex> lock{mutex};
+        results[which] = std::move(result);
+        finished.notify_all();
+    };
+    auto primary = std::async(std::launch::async, run, primaryClient.get(), 0);
+    std::future<void> hedge;
+
+    std::unique_lock<std::mutex> lock{mutex};
+    if (!finished.wait_for(lock, *hedgeDelay, [&]() { return results[0].has_value(); })) {
+        ++hedgedRequests;
+        hedgeClient = leaseClient(remaining - *hedgeDelay);
+        hedge = std::async(std::launch::async, run, hedgeClient.get(), 1);
+    }
+    // wait for a success, or for every request that was sent to fail, but not past the deadline
+    bool decided = finished.wait_until(lock, deadline, [&]() {
+        bool anyOk = (results[0] && results[0]->outcome == Outcome::OK) || (results[1] && results[1]->outcome == Outcome::OK);
+        return anyOk || (results[0] && (!hedge.valid() || results[1]));
+    });
+    size_t winner = results[0] && (results[0]->outcome == Outcome::OK || !results[1]) ? 0 : 1;
+    lock.unlock();
+
+    // the requests hold pointers into this frame, so they must be done before returning;
+    // a request still in flight is cut short by shutting its socket down
+    std::unique_ptr<httplib::Client>* clients[2] = {&primaryClient, &hedgeClient};
+    if (!decided) {
+        primaryClient->stop();
+        if (hedgeClient) {
+            hedgeClient->stop();
+        }
+    } else if (hedge.valid()) {
+        (*clients[1 - winner])->stop();
+    }
+    if (hedge.valid()) {
+        hedge.wait();
+    }
+    primary.wait();
+    if (!decided) {
+        return {Outcome::RETRY, "deadline exceeded"};
+    }
+
+    Attempt result = std::move(*results[winner]);
+    if (result.outcome == Outcome::OK) {
+        clientPool.release(std::move(*clients[winner]));
+    }
+    return result;
+}
+
+static std::string fetchFromWeb(const std::string& resource) {
+    /*
+    This function is used to get some information from the web.
+    Responses are served from the on-disk cache when possible, and stored there after
+    a successful request.
+
+    Failed requests are retried up to `retries` times, waiting a random time of up to
+    `backoffMs` doubled for every retry (full jitter) in between. Every request is bounded
+    by the connect and read timeouts, and the whole fetch, including retries, backoff and
+    requests that are still in flight, by `deadlineMs` (see `Watchdog`). Throws
+    `std::runtime_error` if the resource cannot be fetched.
+    */
+    if (auto cached = diskCache->get(resource)) {
+        ++cacheHits;
+        return *cached;
+    }
+
+    using namespace std::chrono;
+    thread_local std::mt19937 random{std::random_device{}()};
+    auto deadline = steady_clock::now() + clampedMs(webOptions.deadlineMs);
+    for (size_t retry = 0;; ++retry) {
+        if (steady_clock::now() >= deadline) {
+            throw std::runtime_error(resource + ": deadline exceeded");
+        }
+
+        auto result = attemptFetch(resource, deadline);
+        if (result.outcome == Outcome::OK) {
+            diskCache->put(resource, result.body);
+            return std::move(result.body);
+        }
+        if (result.outcome == Outcome::FAIL || retry >= webOptions.retries) {
+            throw std::runtime_error(resource + ": " + result.body);
+        }
+
+        int shift = static_cast<int>(std::min<size_t>(retry, 20));
+        long long cap = std::min<long long>(webOptions.backoffMs, clampedMs(webOptions.deadlineMs).count()) << shift;
+        auto backoff = milliseconds(std::uniform_int_distribution<long long>(0, std::max(cap, 0LL))(random));
+        if (steady_clock::now() + backoff >= deadline) {
+            throw std::runtime_error(resource + ": " + result.body + ", no time left to retry");
+        }
+        ++retryCount;
+        std::this_thread::sleep_for(backoff);
+    }
+}
+
+static void completeLookup(const std::string& resource, std::promise<std::string>& promise) {
+    /*
+    Fetch `resource` for the lookup that started it, publish the result to everyone
+    waiting on `promise`, and keep a successful response for the rest of the run.
+    */
+    try {
+        std::string body = fetchFromWeb(resource);
+        {
+            std::lock_guard<std::mutex> lock{lookupMutex};
+            fetched[resource] = body;
+            inFlight.erase(resource);
+        }
+        promise.set_value(std::move(body));
+    } catch(...) {
+        {
+            std::lock_guard<std::mutex> lock{lookupMutex};
+            inFlight.erase(resource);
+        }
+        promise.set_exception(std::current_exception());
+    }
+}
+
+std::string getFromWeb(const std::string& resource) {
+    /*
+    Get `resource` from the web, fetching it at most once per run.
+
+    Resources that were already fetched (including by `prefetchFromWeb`) are served from
+    memory. If another lookup for the same resource is in flight, this waits for and
+    shares its result. Otherwise the resource is fetched on the calling thread.
+    */
+    std::promise<std::string> promise;
+    std::shared_future<std::string> result;
+    bool owner = false;
+    {
+        std::lock_guard<std::mutex> lock{lookupMutex};
+        if (auto it = prefetched.find(resource); it != prefetched.end()) {
+            return it->second;
+        }
+        if (auto it = fetched.find(resource); it != fetched.end()) {
+            return it->second;
+        }
+        auto [it, inserted] = inFlight.try_emplace(resource);
+        if (inserted) {
+            it->second = promise.get_future().share();
+            owner = true;
+        } else {
+            ++coalescedRequests;
+        }
+        result = it->second;
+    }
+
+    if (owner) {
+        completeLookup(resource, promise);
+    }
+    return result.get();
+}
+
+std::shared_future<std::string> getFromWebAsync(const std::string& resource) {
+    /*
+    Start getting `resource` from the web and return a future for the response.
+
+    Like `getFromWeb`, each resource is fetched at most once per run, but the fetch runs
+    on one of at most `WebOptions::concurrency` lookup threads, so many lookups can be
+    started at once and awaited together; beyond that number they wait in a queue. A failed lookup stores the
+    exception `getFromWeb` would have thrown in the future. Every lookup that shares
+    another one's fetch, in flight or finished, counts as a saved fetch.
+    */
+    auto promise = std::make_shared<std::promise<std::string>>();
+    std::shared_future<std::string> result;
+    {
+        std::lock_guard<std::mutex> lock{lookupMutex};
+        if (auto it = prefetched.find(resource); it != prefetched.end()) {
+            promise->set_value(it->second);
+            return promise->get_future().share();
+        }
+        if (auto it = fetched.find(resource); it != fetched.end()) {
+            ++coalescedRequests;
+            promise->set_value(it->second);
+            return promise->get_future().share();
+        }
+        auto [it, inserted] = inFlight.try_emplace(resource);
+        if (!inserted) {
+            ++coalescedRequests;
+            return it->second;
+        }
+        result = it->second = promise->get_future().share();
+    }
+
+    fetchExecutor.submit([resource, promise]() {
+        completeLookup(resource, *promise);
+    }, webOptions.concurrency);
+    return result;
+}
+
+static bool fetchBatch(const std::vector<std::string>& resources) {
+    /*
+    Send one batch request for `resources` and keep every response it contains.
+    Returns false if the server does not support batch requests (404, 405 or 501). If the
+    request fails otherwise (e.g. a timeout or a 5xx response), only the resources of this
+    batch are left to `getFromWeb`.
+    */
+    nlohmann::json request;
+    request["resources"] = resources;
+
+    auto remaining = clampedMs(webOptions.deadlineMs);
+    auto client = leaseClient(remaining);
+    ++batchRequests;
+
+    auto token = watchdog.arm(*client, std::chrono::steady_clock::now() + remaining);
+    auto res = client->Post(webOptions.batchPath, request.dump(), "application/json");
+    watchdog.disarm(token);
+    if (!res) {
+        return true;
+    }
+    if (res->status == httplib::NotFound_404 || res->status == httplib::MethodNotAllowed_405
+        || res->status == httplib::NotImplemented_501) {
+        return false;
+    }
+    if (res->status != httplib::OK_200) {
+        return true;
+    }
+    clientPool.release(std::move(client));
+
+    nlohmann::json results = nlohmann::json::parse(res->body, nullptr, false);
+    if (!results.is_object()) {
+        return true;
+    }
+    for (auto& resource : resources) {
+        auto it = results.find(resource);
+        if (it == results.end() || !it->is_object()) {
+            continue;
+        }
+        std::string body = it->dump();
+        diskCache->put(resource, body);
+        std::lock_guard<std::mutex> lock{lookupMutex};
+        prefetched[resource] = std::move(body);
+        ++batchedResources;
+    }
+    return true;
+}
+
+void prefetchFromWeb(const std::vector<std::string>& resources) {
+    /*
+    Fetch many resources (e.g. "/isbn/..." and "/title/..." paths) with as few requests
+    as possible, so that the following `getFromWeb` calls for them need no round trip.
+
+    This does nothing unless a batch endpoint is configured. Resources this process
+    already has, or is fetching, are skipped; the ones that are not cached on disk either
+    are POSTed to it in groups of `batchSize` as {"resources": [...]}, and the
+    server answers with an object mapping each resource to the response `getFromWeb`
+    would have received for it. Resources missing from the answer are fetched one by one
+    later, and so are all resources of a batch request that failed. If the server does not
+    support batch requests, batching is turned off for the rest of the run (or of `docman
+    serve`) and every resource falls back to its own request.
+    */
+    if (!batchSupported) {
+        return;
+    }
+
+    std::vector<std::string> missing;
+    for (auto& resource : std::set<std::string>(resources.begin(), resources.end())) {
+        {
+            std::lock_guard<std::mutex> lock{lookupMutex};
+            if (prefetched.count(resource) || fetched.count(resource) || inFlight.count(resource)) {
+                continue;
+            }
+        }
+        if (auto cached = diskCache->get(resource)) {
+            ++cacheHits;
+            std::lock_guard<std::mutex> lock{lookupMutex};
+            prefetched[resource] = std::move(*cached);
+        } else {
+            missing.push_back(resource);
+        }
+    }
+
+    size_t batchSize = webOptions.batchSize > 0 ? webOptions.batchSize : 1;
+    for (size_t begin = 0; begin < missing.size() && batchSupported; begin += batchSize) {
+        std::vector<std::string> batch(
+            missing.begin() + begin,
+            missing.begin() + std::min(begin + batchSize, missing.size())
+        );
+        if (!fetchBatch(batch)) {
+            batchSupported = false;
+        }
+    }
+}
+
+WebStats getWebStats() {
+    WebStats stats;
+    stats.cacheHits = cacheHits;
+    stats.requests = requestCount;
+    stats.connectionsOpened = connectionsOpened;
+    stats.connectionsReused = connectionsReused;
+    stats.batchRequests = batchRequests;
+    stats.batchedResources = batchedResources;
+    stats.coalescedRequests = coalescedRequests;
+    stats.retries = retryCount;
+    stats.hedgedRequests = hedgedRequests;
+    return stats;
+}
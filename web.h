@@ -0,0 +1,46 @@
+#ifndef WEB_H
+#define WEB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+struct WebOptions {
+    std::string endpoint = API_ENDPOINT;
+    std::string cacheDir;                       // empty: no on-disk cache
+    long long cacheTtl = 30 * 24 * 60 * 60;     // seconds
+    std::uintmax_t cacheMaxBytes = 64 << 20;
+    std::string batchPath;                      // empty: no batch requests
+    size_t batchSize = 100;                     // resources per batch request
+    long long connectTimeoutMs = 3000;
+    long long readTimeoutMs = 10000;
+    size_t retries = 3;                         // retries after the first failed request
+    long long backoffMs = 100;                  // base of the jittered exponential backoff
+    long long deadlineMs = 30000;               // bound on one lookup, including retries
+    bool hedge = false;                         // send a second request after the p95 latency
+    size_t concurrency = 8;                     // threads running asynchronous lookups
+};
+
+struct WebStats {
+    size_t cacheHits = 0;
+    size_t requests = 0;
+    size_t connectionsOpened = 0;
+    size_t connectionsReused = 0;
+    size_t batchRequests = 0;
+    size_t batchedResources = 0;
+    size_t coalescedRequests = 0;               // lookups that shared another lookup's fetch
+    size_t retries = 0;
+    size_t hedgedRequests = 0;
+};
+
+void configureWeb(const WebOptions& options);
+std::string getFromWeb(const std::string& resource);
+std::shared_future<std::string> getFromWebAsync(const std::string& resource);
+void prefetchFromWeb(const std::vector<std::string>& resources);
+WebStats getWebStats();
+
+#endif